@@ -0,0 +1,481 @@
+#include "aabb_tree.h"
+
+#include <algorithm>
+#include <cmath>
+
+AABB::AABB() : min(0.0f), max(0.0f) {}
+
+AABB::AABB(const glm::vec3 &min, const glm::vec3 &max) : min(min), max(max)
+{
+}
+
+AABB AABB::transformed(const glm::vec3 &center, const glm::vec3 &halfExtent,
+                       const glm::mat4 &transform)
+{
+  // each axis of the result spans the absolute projections of the rotated
+  // half extents
+  glm::vec3 newCenter(transform[3]);
+  glm::vec3 newHalf(0.0f);
+  for (int axis = 0; axis < 3; axis++)
+    for (int i = 0; i < 3; i++) {
+      newCenter[axis] += transform[i][axis] * center[i];
+      newHalf[axis] += fabsf(transform[i][axis]) * halfExtent[i];
+    }
+  return AABB(newCenter - newHalf, newCenter + newHalf);
+}
+
+bool AABB::contains(const AABB &other) const
+{
+  return min.x <= other.min.x && min.y <= other.min.y &&
+         min.z <= other.min.z && other.max.x <= max.x &&
+         other.max.y <= max.y && other.max.z <= max.z;
+}
+
+AABB AABB::merge(const AABB &other) const
+{
+  return AABB(glm::min(min, other.min), glm::max(max, other.max));
+}
+
+AABB AABB::expand(float margin) const
+{
+  return AABB(min - glm::vec3(margin), max + glm::vec3(margin));
+}
+
+float AABB::getSurfaceArea() const
+{
+  glm::vec3 size = max - min;
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+namespace {
+bool sameBox(const AABB &a, const AABB &b)
+{
+  return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z &&
+         a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+}
+}
+
+AABBTree::AABBTree(float margin)
+    : margin(margin), root(NULL_NODE), freeList(NULL_NODE),
+      freeProxies(NULL_NODE), leafCount(0), reinsertHead(0)
+{
+}
+
+int AABBTree::insert(const AABB &box, unsigned int userData)
+{
+  int proxy;
+  if (freeProxies != NULL_NODE) {
+    proxy = freeProxies;
+    freeProxies = proxies[proxy].node;
+  } else {
+    proxy = (int)proxies.size();
+    proxies.push_back(Proxy());
+  }
+  int leaf = allocateNode();
+  Node &node = nodes[leaf];
+  node.box = box.expand(margin);
+  node.userData = userData;
+  node.proxy = proxy;
+  proxies[proxy].node = leaf;
+  proxies[proxy].refitQueued = proxies[proxy].reinsertQueued = false;
+  insertLeaf(leaf);
+  leafCount++;
+  return proxy;
+}
+
+void AABBTree::remove(int proxy)
+{
+  int leaf = proxies[proxy].node;
+  removeLeaf(leaf);
+  freeNode(leaf);
+  leafCount--;
+  // the queues skip it from here on
+  proxies[proxy].node = freeProxies;
+  proxies[proxy].refitQueued = proxies[proxy].reinsertQueued = false;
+  freeProxies = proxy;
+}
+
+bool AABBTree::update(int proxy, const AABB &box)
+{
+  Proxy &entry = proxies[proxy];
+  Node &node = nodes[entry.node];
+  if (node.box.contains(box))
+    return false;
+
+  node.box = box.expand(margin);
+  if (!entry.refitQueued) {
+    entry.refitQueued = true;
+    refitQueue.push_back(proxy);
+  }
+  if (!entry.reinsertQueued) {
+    entry.reinsertQueued = true;
+    reinsertQueue.push_back(proxy);
+  }
+  return true;
+}
+
+void AABBTree::refit()
+{
+  for (int proxy : refitQueue) {
+    // removed since it was queued, or queued twice
+    if (!proxies[proxy].refitQueued)
+      continue;
+    proxies[proxy].refitQueued = false;
+    int leaf = proxies[proxy].node;
+    // stop where a box comes out unchanged, the rest above is right
+    for (int node = nodes[leaf].parent; node != NULL_NODE;
+         node = nodes[node].parent) {
+      AABB old = nodes[node].box;
+      fit(node);
+      if (sameBox(old, nodes[node].box))
+        break;
+    }
+  }
+  refitQueue.clear();
+}
+
+size_t AABBTree::rebalance(size_t count)
+{
+  size_t done = 0;
+  while (done < count && reinsertHead < reinsertQueue.size()) {
+    int proxy = reinsertQueue[reinsertHead++];
+    if (!proxies[proxy].reinsertQueued)
+      continue;
+    proxies[proxy].reinsertQueued = false;
+    int leaf = proxies[proxy].node;
+    // removing and inserting refits the path as well
+    removeLeaf(leaf);
+    insertLeaf(leaf);
+    done++;
+  }
+  if (reinsertHead == reinsertQueue.size()) {
+    reinsertQueue.clear();
+    reinsertHead = 0;
+  }
+  return done;
+}
+
+void AABBTree::clear()
+{
+  nodes.clear();
+  root = freeList = NULL_NODE;
+  proxies.clear();
+  freeProxies = NULL_NODE;
+  leafCount = 0;
+  refitQueue.clear();
+  reinsertQueue.clear();
+  reinsertHead = 0;
+}
+
+void AABBTree::optimizeLayout()
+{
+  // copy in preorder, first child right after its parent, then fix up the
+  // links through where every node went
+  std::vector<Node> ordered;
+  ordered.reserve(leafCount == 0 ? 0 : 2 * leafCount - 1);
+  std::vector<int> moved(nodes.size(), (int)NULL_NODE);
+  std::vector<int> stack;
+  if (root != NULL_NODE)
+    stack.push_back(root);
+  while (!stack.empty()) {
+    int index = stack.back();
+    stack.pop_back();
+    moved[index] = (int)ordered.size();
+    ordered.push_back(nodes[index]);
+    if (!nodes[index].isLeaf()) {
+      stack.push_back(nodes[index].child2);
+      stack.push_back(nodes[index].child1);
+    }
+  }
+  for (size_t i = 0; i < ordered.size(); i++) {
+    Node &node = ordered[i];
+    if (node.parent != NULL_NODE)
+      node.parent = moved[node.parent];
+    if (node.isLeaf()) {
+      proxies[node.proxy].node = (int)i;
+    } else {
+      node.child1 = moved[node.child1];
+      node.child2 = moved[node.child2];
+    }
+  }
+  nodes.swap(ordered);
+  root = nodes.empty() ? NULL_NODE : 0;
+  freeList = NULL_NODE;
+}
+
+void AABBTree::queryFrustum(const Frustum &frustum,
+                            std::vector<unsigned int> &result) const
+{
+  if (root == NULL_NODE)
+    return;
+
+  // a node entirely on the inner side of a plane has its children there
+  // too, so each entry carries the planes still worth testing
+  struct Entry
+  {
+    int node;
+    unsigned int planes;
+  };
+  const unsigned int allPlanes = (1u << Frustum::PLANE_COUNT) - 1;
+  std::vector<Entry> stack;
+  stack.reserve(64);
+  stack.push_back(Entry{root, allPlanes});
+  while (!stack.empty()) {
+    Entry entry = stack.back();
+    stack.pop_back();
+    const Node &node = nodes[entry.node];
+
+    bool outside = false;
+    for (int p = 0; p < Frustum::PLANE_COUNT && !outside; p++) {
+      if (!(entry.planes & (1u << p)))
+        continue;
+      const glm::vec4 &plane = frustum.planes[p];
+      // the corners farthest along and against the plane normal
+      glm::vec3 positive(plane.x >= 0.0f ? node.box.max.x : node.box.min.x,
+                         plane.y >= 0.0f ? node.box.max.y : node.box.min.y,
+                         plane.z >= 0.0f ? node.box.max.z : node.box.min.z);
+      glm::vec3 negative(plane.x >= 0.0f ? node.box.min.x : node.box.max.x,
+                         plane.y >= 0.0f ? node.box.min.y : node.box.max.y,
+                         plane.z >= 0.0f ? node.box.min.z : node.box.max.z);
+      if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+        outside = true;
+      else if (glm::dot(glm::vec3(plane), negative) + plane.w >= 0.0f)
+        entry.planes &= ~(1u << p);
+    }
+    if (outside)
+      continue;
+
+    // with no planes left the children are taken without a test
+    if (node.isLeaf()) {
+      result.push_back(node.userData);
+    } else {
+      stack.push_back(Entry{node.child1, entry.planes});
+      stack.push_back(Entry{node.child2, entry.planes});
+    }
+  }
+}
+
+void AABBTree::queryRay(const glm::vec3 &origin, const glm::vec3 &direction,
+                        float maxDistance,
+                        std::vector<unsigned int> &result) const
+{
+  if (root == NULL_NODE)
+    return;
+
+  glm::vec3 inverse(1.0f / direction.x, 1.0f / direction.y,
+                    1.0f / direction.z);
+  std::vector<int> stack;
+  stack.reserve(64);
+  stack.push_back(root);
+  while (!stack.empty()) {
+    const Node &node = nodes[stack.back()];
+    stack.pop_back();
+
+    // slab test: the ray is inside all three slabs on [enter, leave]
+    glm::vec3 t1 = (node.box.min - origin) * inverse;
+    glm::vec3 t2 = (node.box.max - origin) * inverse;
+    glm::vec3 tMin = glm::min(t1, t2), tMax = glm::max(t1, t2);
+    float enter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+    float leave = std::min(std::min(tMax.x, tMax.y),
+                         std::min(tMax.z, maxDistance));
+    if (enter > leave)
+      continue;
+
+    if (node.isLeaf()) {
+      result.push_back(node.userData);
+    } else {
+      stack.push_back(node.child1);
+      stack.push_back(node.child2);
+    }
+  }
+}
+
+const AABB &AABBTree::getFatAABB(int proxy) const
+{
+  return nodes[proxies[proxy].node].box;
+}
+
+unsigned int AABBTree::getUserData(int proxy) const
+{
+  return nodes[proxies[proxy].node].userData;
+}
+
+int AABBTree::getHeight() const
+{
+  return root == NULL_NODE ? 0 : nodes[root].height;
+}
+
+size_t AABBTree::getLeafCount() const
+{
+  return leafCount;
+}
+
+int AABBTree::allocateNode()
+{
+  int index;
+  if (freeList != NULL_NODE) {
+    index = freeList;
+    freeList = nodes[index].parent;
+  } else {
+    index = (int)nodes.size();
+    nodes.push_back(Node());
+  }
+  Node &node = nodes[index];
+  node.parent = node.child1 = node.child2 = NULL_NODE;
+  node.height = 0;
+  node.userData = 0;
+  node.proxy = NULL_NODE;
+  return index;
+}
+
+void AABBTree::freeNode(int node)
+{
+  nodes[node].parent = freeList;
+  nodes[node].height = -1;
+  freeList = node;
+}
+
+void AABBTree::insertLeaf(int leaf)
+{
+  if (root == NULL_NODE) {
+    root = leaf;
+    nodes[leaf].parent = NULL_NODE;
+    return;
+  }
+
+  // 1. walk down to the sibling that makes the tree cheapest: the new
+  // parent's area, plus the area every ancestor grows by
+  AABB box = nodes[leaf].box;
+  int index = root;
+  while (!nodes[index].isLeaf()) {
+    const Node &node = nodes[index];
+    float area = node.box.getSurfaceArea();
+    float combinedArea = node.box.merge(box).getSurfaceArea();
+    // pair up with this node right here
+    float cost = 2.0f * combinedArea;
+    // the least any descent costs above this level
+    float inheritance = 2.0f * (combinedArea - area);
+
+    float childCost[2];
+    int children[2] = {node.child1, node.child2};
+    for (int i = 0; i < 2; i++) {
+      const Node &child = nodes[children[i]];
+      float merged = child.box.merge(box).getSurfaceArea();
+      childCost[i] = (child.isLeaf() ? merged
+                                     : merged - child.box.getSurfaceArea()) +
+                     inheritance;
+    }
+    if (cost < childCost[0] && cost < childCost[1])
+      break;
+    index = childCost[0] < childCost[1] ? children[0] : children[1];
+  }
+  int sibling = index;
+
+  // 2. a new parent for leaf and sibling, in the sibling's place
+  int oldParent = nodes[sibling].parent;
+  int newParent = allocateNode();
+  nodes[newParent].parent = oldParent;
+  nodes[newParent].child1 = sibling;
+  nodes[newParent].child2 = leaf;
+  nodes[newParent].box = box.merge(nodes[sibling].box);
+  nodes[newParent].height = nodes[sibling].height + 1;
+  nodes[sibling].parent = newParent;
+  nodes[leaf].parent = newParent;
+  if (oldParent == NULL_NODE)
+    root = newParent;
+  else if (nodes[oldParent].child1 == sibling)
+    nodes[oldParent].child1 = newParent;
+  else
+    nodes[oldParent].child2 = newParent;
+
+  // 3. back up: balance and refit the ancestors
+  for (index = nodes[leaf].parent; index != NULL_NODE;
+       index = nodes[index].parent) {
+    index = balance(index);
+    fit(index);
+  }
+}
+
+void AABBTree::removeLeaf(int leaf)
+{
+  if (leaf == root) {
+    root = NULL_NODE;
+    return;
+  }
+
+  // the sibling takes the parent's place, the parent goes away
+  int parent = nodes[leaf].parent;
+  int grandParent = nodes[parent].parent;
+  int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2
+                                             : nodes[parent].child1;
+  freeNode(parent);
+  nodes[sibling].parent = grandParent;
+  if (grandParent == NULL_NODE) {
+    root = sibling;
+    return;
+  }
+  if (nodes[grandParent].child1 == parent)
+    nodes[grandParent].child1 = sibling;
+  else
+    nodes[grandParent].child2 = sibling;
+
+  for (int index = grandParent; index != NULL_NODE;
+       index = nodes[index].parent) {
+    index = balance(index);
+    fit(index);
+  }
+}
+
+void AABBTree::fit(int node)
+{
+  Node &n = nodes[node];
+  const Node &child1 = nodes[n.child1];
+  const Node &child2 = nodes[n.child2];
+  n.box = child1.box.merge(child2.box);
+  n.height = 1 + std::max(child1.height, child2.height);
+}
+
+int AABBTree::balance(int iA)
+{
+  Node &a = nodes[iA];
+  if (a.isLeaf() || a.height < 2)
+    return iA;
+
+  int iB = a.child1, iC = a.child2;
+  Node &b = nodes[iB];
+  Node &c = nodes[iC];
+  int difference = c.height - b.height;
+  if (difference >= -1 && difference <= 1)
+    return iA;
+
+  // lift the taller child (up) into a's place, a keeps the shorter child
+  // and takes the shorter grandchild; the taller grandchild stays with up
+  bool liftC = difference > 1;
+  int iUp = liftC ? iC : iB;
+  Node &up = nodes[iUp];
+  int iF = up.child1, iG = up.child2;
+  Node &f = nodes[iF];
+  Node &g = nodes[iG];
+
+  up.child1 = iA;
+  up.parent = a.parent;
+  a.parent = iUp;
+  if (up.parent == NULL_NODE)
+    root = iUp;
+  else if (nodes[up.parent].child1 == iA)
+    nodes[up.parent].child1 = iUp;
+  else
+    nodes[up.parent].child2 = iUp;
+
+  int iTall = f.height > g.height ? iF : iG;
+  int iShort = iTall == iF ? iG : iF;
+  up.child2 = iTall;
+  if (liftC)
+    a.child2 = iShort;
+  else
+    a.child1 = iShort;
+  nodes[iShort].parent = iA;
+  fit(iA);
+  fit(iUp);
+  return iUp;
+}
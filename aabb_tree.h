@@ -0,0 +1,128 @@
+#ifndef AABB_TREE_H
+#define AABB_TREE_H
+
+#include <glm/glm.hpp>
+#include "frustum_culler.h"
+
+#include <cstddef>
+#include <vector>
+
+// an axis aligned bounding box
+struct AABB
+{
+  glm::vec3 min;
+  glm::vec3 max;
+
+  AABB();
+  AABB(const glm::vec3 &min, const glm::vec3 &max);
+  // the box around a box of halfExtent centered at center after rotation
+  // (the upper 3x3 of transform) and translation by transform
+  static AABB transformed(const glm::vec3 &center, const glm::vec3 &halfExtent,
+                          const glm::mat4 &transform);
+
+  bool contains(const AABB &other) const;
+  AABB merge(const AABB &other) const;
+  AABB expand(float margin) const;
+  float getSurfaceArea() const;
+};
+
+// A dynamic bounding volume hierarchy (after Box2D's b2DynamicTree). Leaves
+// store a fat box, the object's box plus a margin, so small movements leave
+// the tree alone. The nodes live in one array and refer to each other by
+// index; removed nodes go to a free list. Inserts pick the sibling that
+// grows the surface area least and rotations keep the tree balanced, so
+// queries visit O(log n) nodes plus what they return. Objects are known by
+// a proxy that maps to their leaf, so optimizeLayout() can move the nodes.
+//
+// Per frame: update() every moved object, then refit() once and
+// rebalance() with a small budget, then query. Now and then, and after
+// building, optimizeLayout().
+class AABBTree
+{
+public:
+  // returned instead of a proxy when nothing can be inserted
+  static const int NULL_NODE = -1;
+
+  explicit AABBTree(float margin = 0.1f);
+
+  // add an object, userData comes back from the queries. Returns its proxy.
+  int insert(const AABB &box, unsigned int userData);
+  void remove(int proxy);
+  // the object of proxy is now in box. Returns false if it still fits the
+  // fat box. Otherwise the leaf gets a new fat box in place; its ancestors
+  // follow on refit() and the leaf is reinserted by rebalance().
+  bool update(int proxy, const AABB &box);
+  // grow or shrink the ancestors of the leaves update() changed. The
+  // structure stays, so this is cheap but lets the tree degrade.
+  void refit();
+  // reinsert up to count of the leaves that moved since their insertion,
+  // oldest first, which restores a good structure. Returns how many.
+  size_t rebalance(size_t count);
+  void clear();
+  // renumber the nodes depth first, so a query walks the array mostly
+  // forwards instead of jumping around it in insertion order
+  void optimizeLayout();
+
+  // the userData of every object whose fat box touches the frustum. Nodes
+  // entirely inside report their whole subtree without more tests.
+  void queryFrustum(const Frustum &frustum,
+                    std::vector<unsigned int> &result) const;
+  // the userData of every object whose fat box the ray hits within
+  // maxDistance; test the objects themselves for the exact hit
+  void queryRay(const glm::vec3 &origin, const glm::vec3 &direction,
+                float maxDistance, std::vector<unsigned int> &result) const;
+
+  const AABB &getFatAABB(int proxy) const;
+  unsigned int getUserData(int proxy) const;
+  // 0 for a single leaf or an empty tree
+  int getHeight() const;
+  size_t getLeafCount() const;
+
+private:
+  struct Node
+  {
+    AABB box;
+    // the parent, or the next free node while on the free list
+    int parent;
+    int child1;
+    int child2;
+    // 0 for a leaf, -1 while free
+    int height;
+    unsigned int userData;
+    // the proxy of a leaf
+    int proxy;
+
+    bool isLeaf() const { return child1 == NULL_NODE; }
+  };
+  struct Proxy
+  {
+    // the leaf, or the next free proxy while on the free list
+    int node;
+    // queued for refit() or rebalance()
+    bool refitQueued;
+    bool reinsertQueued;
+  };
+
+  float margin;
+  std::vector<Node> nodes;
+  int root;
+  int freeList;
+  std::vector<Proxy> proxies;
+  int freeProxies;
+  size_t leafCount;
+  // proxies, reinsertQueue is a FIFO and reinsertHead the next one out
+  std::vector<int> refitQueue;
+  std::vector<int> reinsertQueue;
+  size_t reinsertHead;
+
+  int allocateNode();
+  void freeNode(int node);
+  void insertLeaf(int leaf);
+  void removeLeaf(int leaf);
+  // set height and box of node from its children
+  void fit(int node);
+  // rotate node if its subtrees' heights differ by more than one, returns
+  // the node now in its place
+  int balance(int node);
+};
+#endif
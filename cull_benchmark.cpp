@@ -0,0 +1,91 @@
+// Culls a million bounding spheres scattered around the camera on every
+// path the CPU has, then the same objects as boxes in an AABBTree, and
+// prints the time per pass. Not a test, the numbers only mean something in
+// an optimized build.
+//   cull_benchmark [objects] [passes]
+#include "aabb_tree.h"
+#include "frustum_culler.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+  size_t objectCount = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  int passes = argc > 2 ? atoi(argv[2]) : 20;
+
+  // the objects fill a cube around the camera, as in triangle with a large
+  // object count, so most of them are behind or beside it
+  float extent = 4.0f * cbrtf((float)objectCount);
+  SphereList spheres;
+  srand(1);
+  for (size_t i = 0; i < objectCount; i++) {
+    glm::vec3 center(rand(), rand(), rand());
+    center = center / (float)RAND_MAX * 2.0f - 1.0f;
+    spheres.add(center * extent, 0.5f + rand() / (float)RAND_MAX);
+  }
+
+  glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f,
+                                          0.1f, 3.0f * extent);
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+                               glm::vec3(0.0f, 1.0f, 0.0f));
+  Frustum frustum = Frustum::fromMatrix(projection * view);
+
+  std::vector<unsigned int> visible(objectCount);
+  size_t expected = 0;
+  for (int path = FrustumCuller::SCALAR; path <= FrustumCuller::getBestPath();
+       path++) {
+    size_t count = 0;
+    double best = 1e30;
+    for (int pass = 0; pass < passes; pass++) {
+      std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      count = FrustumCuller::cull(frustum, spheres, visible.data(),
+                                  (FrustumCuller::Path)path);
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      best = std::min(best, elapsed.count());
+    }
+    if (path == FrustumCuller::SCALAR)
+      expected = count;
+    std::cout << FrustumCuller::getPathName((FrustumCuller::Path)path) << ": "
+              << best << " ms for " << objectCount << " objects, " << count
+              << " visible" << std::endl;
+    if (count != expected)
+      std::cout << "ERROR::CULL_BENCHMARK::MISMATCH " << count << " visible, "
+                << "scalar found " << expected << std::endl;
+  }
+
+  // the tree finds the boxes around the spheres, a few more than the
+  // spheres themselves, while visiting only the nodes near the frustum
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  AABBTree tree;
+  for (size_t i = 0; i < objectCount; i++) {
+    glm::vec3 center(spheres.x[i], spheres.y[i], spheres.z[i]);
+    glm::vec3 radius(spheres.radius[i]);
+    tree.insert(AABB(center - radius, center + radius), (unsigned int)i);
+  }
+  tree.optimizeLayout();
+  std::chrono::duration<double, std::milli> built =
+      std::chrono::steady_clock::now() - start;
+  std::vector<unsigned int> found;
+  double best = 1e30;
+  for (int pass = 0; pass < passes; pass++) {
+    found.clear();
+    start = std::chrono::steady_clock::now();
+    tree.queryFrustum(frustum, found);
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  std::cout << "tree: " << best << " ms for " << objectCount << " objects, "
+            << found.size() << " visible, height " << tree.getHeight()
+            << ", built in " << built.count() << " ms" << std::endl;
+  return 0;
+}
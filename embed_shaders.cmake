@@ -0,0 +1,38 @@
+# Turns GLSL files into a header of constexpr character arrays, so the
+# shaders are compiled into the binary instead of read at startup. Run as
+#   cmake -DOUTPUT=<header> -DINPUTS=<file;file;...> -P embed_shaders.cmake
+
+set(content "// generated by embed_shaders.cmake from the .glsl files, do not edit\n")
+set(content "${content}#ifndef EMBEDDED_SHADERS_H\n#define EMBEDDED_SHADERS_H\n\n")
+set(content "${content}#include \"shader_source.h\"\n\n")
+
+set(table "")
+set(count 0)
+foreach(input ${INPUTS})
+  get_filename_component(name ${input} NAME)
+  string(MAKE_C_IDENTIFIER ${name} id)
+
+  file(READ ${input} hex HEX)
+  string(LENGTH "${hex}" hexLength)
+  math(EXPR size "${hexLength} / 2")
+  # 16 bytes per line, then every byte as 0x.., plus the terminating zero
+  string(REGEX REPLACE "(................................)" "\\1\n  " hex "${hex}")
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1, " bytes "${hex}")
+  string(REPLACE ", \n" ",\n" bytes "${bytes}")
+
+  set(content "${content}constexpr char ${id}_data[] = {\n  ${bytes}0x00};\n")
+  set(content "${content}constexpr EmbeddedShader ${id} = {\"${name}\", ${id}_data, ${size}};\n\n")
+  set(table "${table}  ${id},\n")
+  math(EXPR count "${count} + 1")
+endforeach()
+
+set(content "${content}constexpr EmbeddedShader embeddedShaders[] = {\n${table}};\n")
+set(content "${content}constexpr size_t embeddedShaderCount = ${count};\n\n#endif\n")
+
+# only touch the header if it changed, so dependents don't rebuild for nothing
+if(EXISTS ${OUTPUT})
+  file(READ ${OUTPUT} previous)
+endif()
+if(NOT "${previous}" STREQUAL "${content}")
+  file(WRITE ${OUTPUT} "${content}")
+endif()
@@ -0,0 +1,202 @@
+#include "frustum_culler.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRUSTUM_CULLER_X86 1
+#endif
+
+Frustum Frustum::fromMatrix(const glm::mat4 &viewProjection)
+{
+  // glm is column major, row i is m[0][i], m[1][i], m[2][i], m[3][i]
+  const glm::mat4 &m = viewProjection;
+  glm::vec4 row[4];
+  for (int i = 0; i < 4; i++)
+    row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+  Frustum frustum;
+  frustum.planes[LEFT] = row[3] + row[0];
+  frustum.planes[RIGHT] = row[3] - row[0];
+  frustum.planes[BOTTOM] = row[3] + row[1];
+  frustum.planes[TOP] = row[3] - row[1];
+  frustum.planes[NEAR] = row[3] + row[2];
+  frustum.planes[FAR] = row[3] - row[2];
+  for (int i = 0; i < PLANE_COUNT; i++) {
+    glm::vec4 &plane = frustum.planes[i];
+    float length = sqrtf(plane.x * plane.x + plane.y * plane.y +
+                         plane.z * plane.z);
+    if (length > 0.0f)
+      plane = plane / length;
+  }
+  return frustum;
+}
+
+void SphereList::add(const glm::vec3 &center, float radius)
+{
+  x.push_back(center.x);
+  y.push_back(center.y);
+  z.push_back(center.z);
+  this->radius.push_back(radius);
+}
+
+void SphereList::clear()
+{
+  x.clear();
+  y.clear();
+  z.clear();
+  radius.clear();
+}
+
+size_t SphereList::size() const
+{
+  return x.size();
+}
+
+FrustumCuller::Path FrustumCuller::getBestPath()
+{
+#ifdef FRUSTUM_CULLER_X86
+  static const Path best = __builtin_cpu_supports("avx2") ? AVX2
+                           : __builtin_cpu_supports("sse2") ? SSE
+                                                            : SCALAR;
+  return best;
+#else
+  return SCALAR;
+#endif
+}
+
+const char* FrustumCuller::getPathName(Path path)
+{
+  switch (path) {
+  case SSE: return "SSE";
+  case AVX2: return "AVX2";
+  default: return "scalar";
+  }
+}
+
+size_t FrustumCuller::cull(const Frustum &frustum, const SphereList &spheres,
+                           unsigned int* visible)
+{
+  return cull(frustum, spheres, visible, getBestPath());
+}
+
+size_t FrustumCuller::cull(const Frustum &frustum, const SphereList &spheres,
+                           unsigned int* visible, Path path)
+{
+  if (path > getBestPath())
+    path = getBestPath();
+  switch (path) {
+  case AVX2: return cullAVX2(frustum, spheres, visible);
+  case SSE: return cullSSE(frustum, spheres, visible);
+  default: return cullScalar(frustum, spheres, 0, visible);
+  }
+}
+
+size_t FrustumCuller::cullScalar(const Frustum &frustum,
+                                 const SphereList &spheres, size_t first,
+                                 unsigned int* visible)
+{
+  size_t count = 0;
+  for (size_t i = first; i < spheres.size(); i++) {
+    bool inside = true;
+    for (int p = 0; p < Frustum::PLANE_COUNT && inside; p++) {
+      const glm::vec4 &plane = frustum.planes[p];
+      // summed in the order of the SIMD paths, so they agree to the bit
+      float distance =
+          (plane.x * spheres.x[i] + plane.y * spheres.y[i]) +
+          (plane.z * spheres.z[i] + (plane.w + spheres.radius[i]));
+      inside = distance >= 0.0f;
+    }
+    if (inside)
+      visible[count++] = (unsigned int)i;
+  }
+  return count;
+}
+
+#ifdef FRUSTUM_CULLER_X86
+size_t FrustumCuller::cullSSE(const Frustum &frustum,
+                              const SphereList &spheres,
+                              unsigned int* visible)
+{
+  __m128 planes[Frustum::PLANE_COUNT][4];
+  for (int p = 0; p < Frustum::PLANE_COUNT; p++)
+    for (int c = 0; c < 4; c++)
+      planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+
+  size_t count = 0;
+  size_t end = spheres.size() & ~(size_t)3;
+  for (size_t i = 0; i < end; i += 4) {
+    __m128 x = _mm_loadu_ps(&spheres.x[i]);
+    __m128 y = _mm_loadu_ps(&spheres.y[i]);
+    __m128 z = _mm_loadu_ps(&spheres.z[i]);
+    // distance + radius >= 0 for every plane
+    __m128 radius = _mm_loadu_ps(&spheres.radius[i]);
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+      __m128 distance = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(planes[p][0], x),
+                     _mm_mul_ps(planes[p][1], y)),
+          _mm_add_ps(_mm_mul_ps(planes[p][2], z),
+                     _mm_add_ps(planes[p][3], radius)));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+    }
+    // compact: one index per set bit
+    unsigned int mask = (unsigned int)_mm_movemask_ps(inside);
+    while (mask) {
+      visible[count++] = (unsigned int)i + __builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+  return count + cullScalar(frustum, spheres, end, visible + count);
+}
+
+__attribute__((target("avx2")))
+size_t FrustumCuller::cullAVX2(const Frustum &frustum,
+                               const SphereList &spheres,
+                               unsigned int* visible)
+{
+  __m256 planes[Frustum::PLANE_COUNT][4];
+  for (int p = 0; p < Frustum::PLANE_COUNT; p++)
+    for (int c = 0; c < 4; c++)
+      planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+
+  size_t count = 0;
+  size_t end = spheres.size() & ~(size_t)7;
+  for (size_t i = 0; i < end; i += 8) {
+    __m256 x = _mm256_loadu_ps(&spheres.x[i]);
+    __m256 y = _mm256_loadu_ps(&spheres.y[i]);
+    __m256 z = _mm256_loadu_ps(&spheres.z[i]);
+    __m256 radius = _mm256_loadu_ps(&spheres.radius[i]);
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+      __m256 distance = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(planes[p][0], x),
+                        _mm256_mul_ps(planes[p][1], y)),
+          _mm256_add_ps(_mm256_mul_ps(planes[p][2], z),
+                        _mm256_add_ps(planes[p][3], radius)));
+      inside = _mm256_and_ps(
+          inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+    }
+    unsigned int mask = (unsigned int)_mm256_movemask_ps(inside);
+    while (mask) {
+      visible[count++] = (unsigned int)i + __builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+  return count + cullScalar(frustum, spheres, end, visible + count);
+}
+#else
+size_t FrustumCuller::cullSSE(const Frustum &frustum,
+                              const SphereList &spheres,
+                              unsigned int* visible)
+{
+  return cullScalar(frustum, spheres, 0, visible);
+}
+
+size_t FrustumCuller::cullAVX2(const Frustum &frustum,
+                               const SphereList &spheres,
+                               unsigned int* visible)
+{
+  return cullScalar(frustum, spheres, 0, visible);
+}
+#endif
@@ -0,0 +1,63 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// the six planes of a view frustum, normals pointing inwards and normalized,
+// so dot(plane, vec4(p, 1)) is the distance of p to the plane
+struct Frustum
+{
+  enum Plane { LEFT, RIGHT, BOTTOM, TOP, NEAR, FAR, PLANE_COUNT };
+  glm::vec4 planes[PLANE_COUNT];
+
+  // extract the planes from projection * view (Gribb/Hartmann). The result
+  // is in world space; pass projection alone for view space.
+  static Frustum fromMatrix(const glm::mat4 &viewProjection);
+};
+
+// bounding spheres as a structure of arrays, so the culling loads four or
+// eight of each coordinate at once
+struct SphereList
+{
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> radius;
+
+  void add(const glm::vec3 &center, float radius);
+  void clear();
+  size_t size() const;
+};
+
+// Tests bounding spheres against a frustum and writes out the indices of
+// the ones that may be visible, in order. SSE takes four spheres per step
+// and AVX2 eight; the widest path the CPU has is picked at runtime.
+class FrustumCuller
+{
+public:
+  enum Path { SCALAR, SSE, AVX2 };
+
+  // the widest path this CPU runs
+  static Path getBestPath();
+  static const char* getPathName(Path path);
+
+  // write the index of every sphere that touches the frustum to visible,
+  // which needs room for spheres.size() entries. Returns how many.
+  static size_t cull(const Frustum &frustum, const SphereList &spheres,
+                     unsigned int* visible);
+  // same, on a given path; falls back to the best one if the CPU lacks it
+  static size_t cull(const Frustum &frustum, const SphereList &spheres,
+                     unsigned int* visible, Path path);
+
+private:
+  static size_t cullScalar(const Frustum &frustum, const SphereList &spheres,
+                           size_t first, unsigned int* visible);
+  static size_t cullSSE(const Frustum &frustum, const SphereList &spheres,
+                        unsigned int* visible);
+  static size_t cullAVX2(const Frustum &frustum, const SphereList &spheres,
+                         unsigned int* visible);
+};
+#endif
@@ -0,0 +1,176 @@
+#include "gl_state.h"
+
+unsigned int GLState::program = GLState::UNKNOWN;
+unsigned int GLState::vertexArray = GLState::UNKNOWN;
+unsigned int GLState::activeTexture = GLState::UNKNOWN;
+std::unordered_map<GLenum, unsigned int> GLState::buffers;
+std::unordered_map<uint64_t, GLState::Range> GLState::indexedBuffers;
+std::unordered_map<uint64_t, unsigned int> GLState::textures;
+std::unordered_map<GLenum, bool> GLState::caps;
+GLState::Stats GLState::frame;
+GLState::Stats GLState::lastFrame;
+GLState::Stats GLState::total;
+
+bool GLState::change(unsigned int &cached, unsigned int value)
+{
+  if (cached == value) {
+    frame.elided++;
+    return false;
+  }
+  cached = value;
+  frame.issued++;
+  return true;
+}
+
+void GLState::useProgram(unsigned int program)
+{
+  if (change(GLState::program, program))
+    glUseProgram(program);
+}
+
+void GLState::bindVertexArray(unsigned int vao)
+{
+  if (!change(vertexArray, vao))
+    return;
+  glBindVertexArray(vao);
+  // the element array binding comes with the VAO
+  buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+}
+
+void GLState::bindBuffer(GLenum target, unsigned int buffer)
+{
+  unsigned int &cached =
+      buffers.insert(std::make_pair(target, UNKNOWN)).first->second;
+  if (change(cached, buffer))
+    glBindBuffer(target, buffer);
+}
+
+void GLState::bindBufferBase(GLenum target, unsigned int index,
+                             unsigned int buffer)
+{
+  bindBufferRange(target, index, buffer, 0, 0);
+}
+
+void GLState::bindBufferRange(GLenum target, unsigned int index,
+                              unsigned int buffer, GLintptr offset,
+                              GLsizeiptr size)
+{
+  uint64_t key = ((uint64_t)target << 32) | index;
+  std::unordered_map<uint64_t, Range>::iterator it = indexedBuffers.find(key);
+  if (it != indexedBuffers.end() && it->second.buffer == buffer &&
+      it->second.offset == offset && it->second.size == size) {
+    frame.elided++;
+    return;
+  }
+
+  // size 0 stands for the whole buffer
+  if (size == 0)
+    glBindBufferBase(target, index, buffer);
+  else
+    glBindBufferRange(target, index, buffer, offset, size);
+  frame.issued++;
+  Range range = {buffer, offset, size};
+  indexedBuffers[key] = range;
+  buffers[target] = buffer;
+}
+
+void GLState::bindTexture(unsigned int unit, GLenum target,
+                          unsigned int texture)
+{
+  uint64_t key = ((uint64_t)unit << 32) | target;
+  unsigned int &cached =
+      textures.insert(std::make_pair(key, UNKNOWN)).first->second;
+  if (cached == texture) {
+    frame.elided++;
+    return;
+  }
+
+  if (change(activeTexture, unit))
+    glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(target, texture);
+  cached = texture;
+  frame.issued++;
+}
+
+void GLState::enable(GLenum cap)
+{
+  setCap(cap, true);
+}
+
+void GLState::disable(GLenum cap)
+{
+  setCap(cap, false);
+}
+
+void GLState::setCap(GLenum cap, bool enabled)
+{
+  std::unordered_map<GLenum, bool>::iterator it = caps.find(cap);
+  if (it != caps.end() && it->second == enabled) {
+    frame.elided++;
+    return;
+  }
+
+  if (enabled)
+    glEnable(cap);
+  else
+    glDisable(cap);
+  frame.issued++;
+  caps[cap] = enabled;
+}
+
+void GLState::deleteBuffer(unsigned int buffer)
+{
+  glDeleteBuffers(1, &buffer);
+  // GL unbinds it everywhere in this context, forget those bindings
+  for (std::pair<const GLenum, unsigned int> &entry : buffers)
+    if (entry.second == buffer)
+      entry.second = UNKNOWN;
+  for (std::pair<const uint64_t, Range> &entry : indexedBuffers)
+    if (entry.second.buffer == buffer)
+      entry.second.buffer = UNKNOWN;
+}
+
+void GLState::deleteVertexArray(unsigned int vao)
+{
+  glDeleteVertexArrays(1, &vao);
+  if (vertexArray == vao) {
+    vertexArray = UNKNOWN;
+    buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+  }
+}
+
+void GLState::deleteTexture(unsigned int texture)
+{
+  glDeleteTextures(1, &texture);
+  for (std::pair<const uint64_t, unsigned int> &entry : textures)
+    if (entry.second == texture)
+      entry.second = UNKNOWN;
+}
+
+void GLState::invalidate()
+{
+  program = vertexArray = activeTexture = UNKNOWN;
+  buffers.clear();
+  indexedBuffers.clear();
+  textures.clear();
+  caps.clear();
+}
+
+GLState::Stats GLState::endFrame()
+{
+  lastFrame = frame;
+  total.issued += frame.issued;
+  total.elided += frame.elided;
+  frame = Stats();
+  return lastFrame;
+}
+
+GLState::Stats GLState::getFrameStats()
+{
+  return lastFrame;
+}
+
+GLState::Stats GLState::getTotalStats()
+{
+  return total;
+}
@@ -0,0 +1,89 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// Shadows the bindings of the current context: program, VAO, buffers,
+// textures per unit and enable flags. Binding what is bound already
+// never reaches the driver. Everything that changes the tracked state has to
+// go through here, or call invalidate() afterwards.
+class GLState
+{
+public:
+  static void useProgram(unsigned int program);
+  static void bindVertexArray(unsigned int vao);
+  // the element array binding is part of the VAO, it is tracked for the
+  // bound VAO only
+  static void bindBuffer(GLenum target, unsigned int buffer);
+  // indexed bindings, e.g. a GL_UNIFORM_BUFFER binding point. Like GL, this
+  // also binds the buffer to target.
+  static void bindBufferBase(GLenum target, unsigned int index,
+                             unsigned int buffer);
+  static void bindBufferRange(GLenum target, unsigned int index,
+                              unsigned int buffer, GLintptr offset,
+                              GLsizeiptr size);
+  // bind texture to target on unit, GL_TEXTURE0 + unit becomes active only
+  // if something has to be bound
+  static void bindTexture(unsigned int unit, GLenum target,
+                          unsigned int texture);
+  static void enable(GLenum cap);
+  static void disable(GLenum cap);
+
+  // deleting an object unbinds it, these keep the shadow in sync
+  static void deleteBuffer(unsigned int buffer);
+  static void deleteVertexArray(unsigned int vao);
+  static void deleteTexture(unsigned int texture);
+
+  // forget everything, e.g. after code that binds by itself. The next call
+  // for each binding reaches the driver.
+  static void invalidate();
+
+  // how many calls reached the driver and how many were elided
+  struct Stats
+  {
+    unsigned long issued;
+    unsigned long elided;
+    Stats() : issued(0), elided(0) {}
+  };
+  // call once per frame, after the last draw. Returns the frame's counts.
+  static Stats endFrame();
+  // the counts of the last finished frame, and of all frames so far
+  static Stats getFrameStats();
+  static Stats getTotalStats();
+
+private:
+  // a binding nobody knows about, forces the next call through
+  static const unsigned int UNKNOWN = ~0u;
+
+  struct Range
+  {
+    unsigned int buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+  };
+
+  static unsigned int program;
+  static unsigned int vertexArray;
+  static unsigned int activeTexture;
+  // target -> buffer; missing means unknown
+  static std::unordered_map<GLenum, unsigned int> buffers;
+  // (target, index) -> range; size 0 for bindBufferBase()
+  static std::unordered_map<uint64_t, Range> indexedBuffers;
+  // (unit, target) -> texture
+  static std::unordered_map<uint64_t, unsigned int> textures;
+  static std::unordered_map<GLenum, bool> caps;
+
+  static Stats frame;
+  static Stats lastFrame;
+  static Stats total;
+
+  // true, and counted as issued, if cached differs from value; the cache is
+  // updated
+  static bool change(unsigned int &cached, unsigned int value);
+  static void setCap(GLenum cap, bool enabled);
+};
+#endif
@@ -0,0 +1,12 @@
+#include "hash.h"
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+{
+  const unsigned char* bytes = (const unsigned char*)data;
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
@@ -0,0 +1,10 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit FNV-1a, chainable through the seed
+uint64_t hashBytes(const void* data, size_t size,
+                   uint64_t seed = 14695981039346656037ULL);
+#endif
@@ -0,0 +1,60 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() : mapping(NULL), length(0) {}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+bool MappedFile::open(const std::string &path)
+{
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+
+  // mmap rejects empty ranges, an empty file is simply an empty view
+  if (st.st_size > 0) {
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      ::close(fd);
+      return false;
+    }
+    mapping = p;
+    length = st.st_size;
+  }
+  // the mapping stays valid after the descriptor is closed
+  ::close(fd);
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (mapping)
+    munmap(mapping, length);
+  mapping = NULL;
+  length = 0;
+}
+
+const char* MappedFile::data() const
+{
+  return (const char*)mapping;
+}
+
+size_t MappedFile::size() const
+{
+  return length;
+}
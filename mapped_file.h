@@ -0,0 +1,28 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// A read-only memory mapping of a whole file. The contents are only valid
+// while the object lives; the file must not be truncated under it.
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // map the file at path, returns false if it can't be opened or mapped
+  bool open(const std::string &path);
+  void close();
+
+  const char* data() const;
+  size_t size() const;
+
+private:
+  void* mapping;
+  size_t length;
+};
+#endif
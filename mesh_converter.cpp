@@ -0,0 +1,181 @@
+// Converts Wavefront .obj meshes into .mesh files, see mesh_file.h. The
+// mesh is welded, ordered for the vertex cache and quantized here, so
+// loading it is a mapping and a glBufferData.
+//   mesh_converter [--float] input.obj output.mesh
+#include "mesh_file.h"
+#include "mesh_processor.h"
+#include "vertex_format.h"
+#include "vertex_quantizer.h"
+
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+// the vertices of an .obj as a float triangle list: position, texture
+// coordinate and, if the file has any, normal
+struct ObjMesh
+{
+  bool hasNormals;
+  std::vector<float> vertices;
+};
+
+// an .obj index is 1 based, or counts back from the end if negative
+bool resolveIndex(const std::string &text, size_t count, size_t &index)
+{
+  if (text.empty())
+    return false;
+  long value = strtol(text.c_str(), NULL, 10);
+  if (value > 0 && (size_t)value <= count)
+    index = value - 1;
+  else if (value < 0 && (size_t)-value <= count)
+    index = count + value;
+  else
+    return false;
+  return true;
+}
+
+bool loadObj(const std::string &path, ObjMesh &mesh)
+{
+  std::ifstream in(path.c_str());
+  if (!in) {
+    std::cout << "ERROR::MESH_CONVERTER::CANNOT_OPEN " << path << std::endl;
+    return false;
+  }
+
+  std::vector<glm::vec3> positions, normals;
+  std::vector<glm::vec2> texCoords;
+  // a corner is position/texcoord/normal, missing parts stay ~0
+  struct Corner
+  {
+    size_t position, texCoord, normal;
+  };
+  std::vector<Corner> corners;
+  std::string line;
+  size_t lineNumber = 0;
+  while (std::getline(in, line)) {
+    lineNumber++;
+    std::istringstream words(line);
+    std::string keyword;
+    words >> keyword;
+    if (keyword == "v") {
+      glm::vec3 p;
+      words >> p.x >> p.y >> p.z;
+      positions.push_back(p);
+    } else if (keyword == "vt") {
+      glm::vec2 t;
+      words >> t.x >> t.y;
+      texCoords.push_back(t);
+    } else if (keyword == "vn") {
+      glm::vec3 n;
+      words >> n.x >> n.y >> n.z;
+      normals.push_back(n);
+    } else if (keyword == "f") {
+      std::vector<Corner> face;
+      std::string word;
+      while (words >> word) {
+        Corner corner = {(size_t)-1, (size_t)-1, (size_t)-1};
+        size_t slash = word.find('/');
+        size_t second = slash == std::string::npos
+                            ? std::string::npos
+                            : word.find('/', slash + 1);
+        if (!resolveIndex(word.substr(0, slash), positions.size(),
+                          corner.position)) {
+          std::cout << "ERROR::MESH_CONVERTER::BAD_FACE " << path << ":"
+                    << lineNumber << std::endl;
+          return false;
+        }
+        if (slash != std::string::npos)
+          resolveIndex(word.substr(slash + 1, second - slash - 1),
+                       texCoords.size(), corner.texCoord);
+        if (second != std::string::npos)
+          resolveIndex(word.substr(second + 1), normals.size(),
+                       corner.normal);
+        face.push_back(corner);
+      }
+      // polygons become a fan
+      for (size_t i = 2; i < face.size(); i++) {
+        corners.push_back(face[0]);
+        corners.push_back(face[i - 1]);
+        corners.push_back(face[i]);
+      }
+    }
+  }
+
+  mesh.hasNormals = !normals.empty();
+  for (const Corner &corner : corners) {
+    glm::vec3 p = positions[corner.position];
+    glm::vec2 t = corner.texCoord < texCoords.size()
+                      ? texCoords[corner.texCoord] : glm::vec2(0.0f);
+    float vertex[8] = {p.x, p.y, p.z, t.x, t.y, 0.0f, 0.0f, 0.0f};
+    if (corner.normal < normals.size()) {
+      vertex[5] = normals[corner.normal].x;
+      vertex[6] = normals[corner.normal].y;
+      vertex[7] = normals[corner.normal].z;
+    }
+    mesh.vertices.insert(mesh.vertices.end(), vertex,
+                         vertex + (mesh.hasNormals ? 8 : 5));
+  }
+  return true;
+}
+}
+
+int main(int argc, char** argv)
+{
+  bool quantize = true;
+  int first = 1;
+  if (argc > 1 && strcmp(argv[1], "--float") == 0) {
+    quantize = false;
+    first = 2;
+  }
+  if (argc - first != 2) {
+    std::cout << "usage: mesh_converter [--float] input.obj output.mesh"
+              << std::endl;
+    return 1;
+  }
+  std::string input = argv[first], output = argv[first + 1];
+
+  ObjMesh obj;
+  if (!loadObj(input, obj))
+    return 1;
+
+  // the layout triangle's shaders take, see VertexQuantizer for the names
+  VertexFormat format;
+  format.add("aPos", 3, GL_FLOAT).add("aTexCoord", 2, GL_FLOAT);
+  if (obj.hasNormals)
+    format.add("aNormal", 3, GL_FLOAT);
+  size_t vertexCount = obj.vertices.size() * sizeof(float) / format.getStride();
+
+  glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+  size_t floatsPerVertex = format.getStride() / sizeof(float);
+  for (size_t i = 0; i < vertexCount; i++) {
+    const float* p = &obj.vertices[i * floatsPerVertex];
+    boundsMin = glm::min(boundsMin, glm::vec3(p[0], p[1], p[2]));
+    boundsMax = glm::max(boundsMax, glm::vec3(p[0], p[1], p[2]));
+  }
+  if (vertexCount == 0)
+    boundsMin = boundsMax = glm::vec3(0.0f);
+
+  MeshStats stats;
+  Mesh mesh = MeshProcessor::process(obj.vertices.data(), vertexCount,
+                                     format.getStride(), NULL, 0, &stats);
+  VertexQuantizer quantizer(format, quantize ? VertexEncoding()
+                                             : VertexEncoding::floats());
+  MeshDecode decode;
+  Mesh quantized = quantizer.quantize(mesh, &decode);
+  if (!MeshFile::write(output, quantized, quantizer.getFormat(), decode,
+                       boundsMin, boundsMax))
+    return 1;
+
+  std::cout << output << ": " << stats.verticesBefore << " -> "
+            << stats.verticesAfter << " vertices, " << quantized.indices.size()
+            << " indices, ACMR " << stats.acmrBefore << " -> "
+            << stats.acmrAfter << ", " << quantizer.getFormat().getStride()
+            << " bytes per vertex" << std::endl;
+  return 0;
+}
@@ -0,0 +1,257 @@
+#include "mesh_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+size_t alignUp(size_t offset)
+{
+  return (offset + MESH_FILE_ALIGNMENT - 1) & ~(MESH_FILE_ALIGNMENT - 1);
+}
+
+// true if [offset, offset + size) is an aligned range inside the file
+bool inFile(uint64_t offset, uint64_t size, size_t fileSize)
+{
+  return offset % MESH_FILE_ALIGNMENT == 0 && offset <= fileSize &&
+         size <= fileSize - offset;
+}
+
+VertexFormat toFormat(const MeshFileStream &stream)
+{
+  VertexFormat format;
+  for (uint32_t i = 0; i < stream.attributeCount; i++) {
+    const MeshFileAttribute &attribute = stream.attributes[i];
+    std::string name(attribute.name,
+                     strnlen(attribute.name, sizeof(attribute.name)));
+    format.add(name, attribute.components, attribute.type,
+               attribute.normalized != 0);
+  }
+  return format;
+}
+
+// the stored layout has to be the one VertexFormat computes
+bool matchesFormat(const MeshFileStream &stream)
+{
+  VertexFormat format = toFormat(stream);
+  for (uint32_t i = 0; i < stream.attributeCount; i++)
+    if (format.getAttributes()[i].offset != stream.attributes[i].offset)
+      return false;
+  return format.getStride() == stream.stride;
+}
+}
+
+MeshFile::MeshFile() : header(NULL) {}
+
+bool MeshFile::open(const std::string &path)
+{
+  close();
+  if (!file.open(path)) {
+    std::cout << "ERROR::MESH_FILE::CANNOT_OPEN " << path << std::endl;
+    return false;
+  }
+
+  const MeshFileHeader* h = (const MeshFileHeader*)file.data();
+  if (file.size() < sizeof(MeshFileHeader) || h->magic != MESH_FILE_MAGIC) {
+    std::cout << "ERROR::MESH_FILE::NOT_A_MESH_FILE " << path << std::endl;
+    file.close();
+    return false;
+  }
+  if (h->version != MESH_FILE_VERSION ||
+      h->headerSize != sizeof(MeshFileHeader)) {
+    std::cout << "ERROR::MESH_FILE::VERSION_MISMATCH " << path << " is "
+              << h->version << ", expected " << MESH_FILE_VERSION
+              << std::endl;
+    file.close();
+    return false;
+  }
+
+  // check every range once, so the getters can trust them
+  bool valid = h->streamCount <= MESH_FILE_MAX_STREAMS &&
+               h->indexCount <= file.size() / sizeof(unsigned int) &&
+               inFile(h->indexOffset, h->indexCount * sizeof(unsigned int),
+                      file.size());
+  for (uint32_t i = 0; valid && i < h->streamCount; i++) {
+    const MeshFileStream &stream = h->streams[i];
+    valid = stream.attributeCount <= MESH_FILE_MAX_ATTRIBUTES &&
+            stream.stride > 0 &&
+            inFile(stream.offset, stream.size, file.size()) &&
+            stream.size % stream.stride == 0 &&
+            stream.size / stream.stride == h->vertexCount &&
+            matchesFormat(stream);
+  }
+  // an index past the vertices would have the GPU read outside the buffer
+  if (valid) {
+    const unsigned int* indices =
+        (const unsigned int*)(file.data() + h->indexOffset);
+    for (uint64_t i = 0; valid && i < h->indexCount; i++)
+      valid = indices[i] < h->vertexCount;
+  }
+  if (!valid) {
+    std::cout << "ERROR::MESH_FILE::CORRUPT " << path << std::endl;
+    file.close();
+    return false;
+  }
+  header = h;
+  return true;
+}
+
+void MeshFile::close()
+{
+  file.close();
+  header = NULL;
+}
+
+bool MeshFile::isOpen() const
+{
+  return header != NULL;
+}
+
+size_t MeshFile::getVertexCount() const
+{
+  return header ? header->vertexCount : 0;
+}
+
+unsigned int MeshFile::getStreamCount() const
+{
+  return header ? header->streamCount : 0;
+}
+
+VertexFormat MeshFile::getFormat(unsigned int stream) const
+{
+  if (stream >= getStreamCount())
+    return VertexFormat();
+  return toFormat(header->streams[stream]);
+}
+
+const void* MeshFile::getVertices(unsigned int stream) const
+{
+  if (stream >= getStreamCount())
+    return NULL;
+  return file.data() + header->streams[stream].offset;
+}
+
+size_t MeshFile::getVertexBytes(unsigned int stream) const
+{
+  return stream < getStreamCount() ? header->streams[stream].size : 0;
+}
+
+const unsigned int* MeshFile::getIndices() const
+{
+  return header ? (const unsigned int*)(file.data() + header->indexOffset)
+                : NULL;
+}
+
+size_t MeshFile::getIndexCount() const
+{
+  return header ? header->indexCount : 0;
+}
+
+MeshDecode MeshFile::getDecode() const
+{
+  MeshDecode decode;
+  if (!header)
+    return decode;
+  decode.positionScale = glm::vec3(header->positionScale[0],
+                                   header->positionScale[1],
+                                   header->positionScale[2]);
+  decode.positionBias = glm::vec3(header->positionBias[0],
+                                  header->positionBias[1],
+                                  header->positionBias[2]);
+  decode.texCoordScale =
+      glm::vec2(header->texCoordScale[0], header->texCoordScale[1]);
+  decode.texCoordBias =
+      glm::vec2(header->texCoordBias[0], header->texCoordBias[1]);
+  return decode;
+}
+
+glm::vec3 MeshFile::getBoundsMin() const
+{
+  if (!header)
+    return glm::vec3(0.0f);
+  return glm::vec3(header->boundsMin[0], header->boundsMin[1],
+                   header->boundsMin[2]);
+}
+
+glm::vec3 MeshFile::getBoundsMax() const
+{
+  if (!header)
+    return glm::vec3(0.0f);
+  return glm::vec3(header->boundsMax[0], header->boundsMax[1],
+                   header->boundsMax[2]);
+}
+
+bool MeshFile::write(const std::string &path, const Mesh &mesh,
+                     const VertexFormat &format, const MeshDecode &decode,
+                     const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+{
+  const std::vector<VertexAttribute> &attributes = format.getAttributes();
+  if (attributes.size() > MESH_FILE_MAX_ATTRIBUTES) {
+    std::cout << "ERROR::MESH_FILE::TOO_MANY_ATTRIBUTES " << path
+              << std::endl;
+    return false;
+  }
+
+  MeshFileHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = MESH_FILE_MAGIC;
+  header.version = MESH_FILE_VERSION;
+  header.headerSize = sizeof(MeshFileHeader);
+  header.streamCount = 1;
+  header.vertexCount = mesh.getVertexCount();
+  header.indexCount = mesh.indices.size();
+  for (int i = 0; i < 3; i++) {
+    header.boundsMin[i] = boundsMin[i];
+    header.boundsMax[i] = boundsMax[i];
+    header.positionScale[i] = decode.positionScale[i];
+    header.positionBias[i] = decode.positionBias[i];
+  }
+  for (int i = 0; i < 2; i++) {
+    header.texCoordScale[i] = decode.texCoordScale[i];
+    header.texCoordBias[i] = decode.texCoordBias[i];
+  }
+
+  MeshFileStream &stream = header.streams[0];
+  stream.offset = alignUp(sizeof(MeshFileHeader));
+  stream.size = mesh.vertices.size();
+  stream.stride = (uint32_t)format.getStride();
+  stream.attributeCount = (uint32_t)attributes.size();
+  for (size_t i = 0; i < attributes.size(); i++) {
+    MeshFileAttribute &attribute = stream.attributes[i];
+    if (attributes[i].name.size() >= sizeof(attribute.name)) {
+      std::cout << "ERROR::MESH_FILE::NAME_TOO_LONG " << attributes[i].name
+                << std::endl;
+      return false;
+    }
+    strcpy(attribute.name, attributes[i].name.c_str());
+    attribute.components = attributes[i].components;
+    attribute.type = attributes[i].type;
+    attribute.normalized = attributes[i].normalized ? 1 : 0;
+    attribute.offset = (uint32_t)attributes[i].offset;
+  }
+  header.indexOffset = alignUp(stream.offset + stream.size);
+
+  // write to a temporary file and rename it into place, so a running
+  // program never maps a half written mesh
+  std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream out(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+    std::vector<char> padding(MESH_FILE_ALIGNMENT, 0);
+    out.write((const char*)&header, sizeof(header));
+    out.write(padding.data(), stream.offset - sizeof(header));
+    out.write((const char*)mesh.vertices.data(), stream.size);
+    out.write(padding.data(),
+              header.indexOffset - (stream.offset + stream.size));
+    out.write((const char*)mesh.indices.data(),
+              mesh.indices.size() * sizeof(unsigned int));
+    if (!out) {
+      std::cout << "ERROR::MESH_FILE::CANNOT_WRITE " << path << std::endl;
+      std::remove(tmpPath.c_str());
+      return false;
+    }
+  }
+  std::rename(tmpPath.c_str(), path.c_str());
+  return true;
+}
@@ -0,0 +1,107 @@
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+
+#include <glm/glm.hpp>
+#include "mapped_file.h"
+#include "mesh_processor.h"
+#include "vertex_format.h"
+#include "vertex_quantizer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// The .mesh container written by mesh_converter. Native (little endian)
+// byte order, laid out so the mapped file goes to glBufferData as it is:
+//   MeshFileHeader
+//   vertex stream 0, 1, ...  each MESH_FILE_ALIGNMENT aligned
+//   indices                  uint32, relative to the mesh, aligned too
+// Bump MESH_FILE_VERSION whenever the layout changes; files of another
+// version are rejected instead of misread.
+const uint32_t MESH_FILE_MAGIC = 0x4853454d; // "MESH"
+const uint32_t MESH_FILE_VERSION = 1;
+const size_t MESH_FILE_ALIGNMENT = 64;
+const unsigned int MESH_FILE_MAX_STREAMS = 4;
+const unsigned int MESH_FILE_MAX_ATTRIBUTES = 8;
+
+// a VertexAttribute, name zero terminated
+struct MeshFileAttribute
+{
+  char name[32];
+  uint32_t components;
+  uint32_t type;
+  uint32_t normalized;
+  uint32_t offset;
+};
+
+// one interleaved vertex buffer, offset and size in bytes from the start of
+// the file
+struct MeshFileStream
+{
+  uint64_t offset;
+  uint64_t size;
+  uint32_t stride;
+  uint32_t attributeCount;
+  MeshFileAttribute attributes[MESH_FILE_MAX_ATTRIBUTES];
+};
+
+struct MeshFileHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  // sizeof(MeshFileHeader) of the writer, a cheap check on the layout
+  uint32_t headerSize;
+  uint32_t streamCount;
+  uint64_t vertexCount;
+  uint64_t indexOffset;
+  uint64_t indexCount;
+  uint64_t reserved;
+  // the box around the decoded positions, in model units
+  float boundsMin[4];
+  float boundsMax[4];
+  // MeshDecode of quantized streams, identity for float ones
+  float positionScale[4];
+  float positionBias[4];
+  float texCoordScale[2];
+  float texCoordBias[2];
+  MeshFileStream streams[MESH_FILE_MAX_STREAMS];
+};
+
+// Maps a .mesh file and hands out views into it. open() checks the header,
+// every range and every index once, nothing is parsed or copied after that.
+// The views are valid until close().
+class MeshFile
+{
+public:
+  MeshFile();
+  MeshFile(const MeshFile &) = delete;
+  MeshFile &operator=(const MeshFile &) = delete;
+
+  // map and check path, prints why and returns false if it isn't a mesh
+  // file of this version
+  bool open(const std::string &path);
+  void close();
+  bool isOpen() const;
+
+  size_t getVertexCount() const;
+  unsigned int getStreamCount() const;
+  VertexFormat getFormat(unsigned int stream) const;
+  const void* getVertices(unsigned int stream) const;
+  size_t getVertexBytes(unsigned int stream) const;
+  const unsigned int* getIndices() const;
+  size_t getIndexCount() const;
+  MeshDecode getDecode() const;
+  glm::vec3 getBoundsMin() const;
+  glm::vec3 getBoundsMax() const;
+
+  // write mesh, laid out as format, as a single stream file. bounds are in
+  // model units, decode tells how to get there from the stored values.
+  static bool write(const std::string &path, const Mesh &mesh,
+                    const VertexFormat &format, const MeshDecode &decode,
+                    const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+
+private:
+  MappedFile file;
+  const MeshFileHeader* header;
+};
+#endif
@@ -0,0 +1,109 @@
+#include "mesh_pool.h"
+#include "gl_state.h"
+
+#include <iostream>
+
+MeshPool::MeshPool(const VertexFormat &format)
+    : quantizer(format, VertexEncoding::floats()), vertexBytes(0),
+      indexCount(0)
+{
+  glGenBuffers(1, &vertexBuffer);
+  glGenBuffers(1, &indexBuffer);
+}
+
+MeshPool::MeshPool(const VertexQuantizer &quantizer)
+    : quantizer(quantizer), vertexBytes(0), indexCount(0)
+{
+  glGenBuffers(1, &vertexBuffer);
+  glGenBuffers(1, &indexBuffer);
+}
+
+MeshPool::~MeshPool()
+{
+  GLState::deleteBuffer(vertexBuffer);
+  GLState::deleteBuffer(indexBuffer);
+}
+
+MeshRange MeshPool::add(const void* vertices, size_t vertexCount,
+                        const unsigned int* indices, size_t indexCount,
+                        MeshStats* stats)
+{
+  Mesh mesh = MeshProcessor::process(vertices, vertexCount,
+                                     quantizer.getSourceFormat().getStride(),
+                                     indices, indexCount, stats);
+  MeshDecode decode;
+  MeshRange range = add(quantizer.quantize(mesh, &decode));
+  range.decode = decode;
+  return range;
+}
+
+MeshRange MeshPool::add(const Mesh &mesh)
+{
+  meshes.push_back(mesh);
+  const Mesh &stored = meshes.back();
+  Part part = {stored.vertices.data(), stored.vertices.size(),
+               stored.indices.data(), stored.indices.size()};
+  return addPart(part);
+}
+
+MeshRange MeshPool::add(const MeshFile &file)
+{
+  if (file.getStreamCount() != 1 ||
+      file.getFormat(0).getHash() != quantizer.getFormat().getHash()) {
+    std::cout << "ERROR::MESH_POOL::FORMAT_MISMATCH" << std::endl;
+    Part empty = {NULL, 0, NULL, 0};
+    return addPart(empty);
+  }
+  Part part = {file.getVertices(0), file.getVertexBytes(0),
+               file.getIndices(), file.getIndexCount()};
+  MeshRange range = addPart(part);
+  range.decode = file.getDecode();
+  return range;
+}
+
+MeshRange MeshPool::addPart(const Part &part)
+{
+  MeshRange range;
+  range.firstIndex = (unsigned int)indexCount;
+  range.indexCount = (unsigned int)part.indexCount;
+  range.baseVertex = (int)(vertexBytes / quantizer.getFormat().getStride());
+
+  parts.push_back(part);
+  vertexBytes += part.vertexBytes;
+  indexCount += part.indexCount;
+  return range;
+}
+
+void MeshPool::upload()
+{
+  // the element array binding belongs to whatever VAO is bound, so the
+  // indices go in through a target that has no such side effect
+  GLState::bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, vertexBytes, NULL, GL_STATIC_DRAW);
+  GLState::bindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+  glBufferData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(unsigned int), NULL,
+               GL_STATIC_DRAW);
+
+  // each part goes from its own memory, e.g. a mapped file, to the driver
+  size_t vertexOffset = 0, indexOffset = 0;
+  for (const Part &part : parts) {
+    if (part.vertexBytes > 0)
+      glBufferSubData(GL_ARRAY_BUFFER, vertexOffset, part.vertexBytes,
+                      part.vertices);
+    if (part.indexCount > 0)
+      glBufferSubData(GL_COPY_WRITE_BUFFER,
+                      indexOffset * sizeof(unsigned int),
+                      part.indexCount * sizeof(unsigned int), part.indices);
+    vertexOffset += part.vertexBytes;
+    indexOffset += part.indexCount;
+  }
+  // files may close now
+  parts.clear();
+  meshes.clear();
+}
+
+VertexStream MeshPool::getStream() const
+{
+  VertexStream stream = {&quantizer.getFormat(), vertexBuffer};
+  return stream;
+}
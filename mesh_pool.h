@@ -0,0 +1,82 @@
+#ifndef MESH_POOL_H
+#define MESH_POOL_H
+
+#include <glad/glad.h>
+#include "mesh_file.h"
+#include "mesh_processor.h"
+#include "vertex_format.h"
+#include "vertex_quantizer.h"
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+// where a mesh lives inside a MeshPool, in the terms of an indexed draw
+struct MeshRange
+{
+  unsigned int firstIndex;
+  unsigned int indexCount;
+  // added to every index of the mesh
+  int baseVertex;
+  // how to read the vertices back if the pool quantizes them
+  MeshDecode decode;
+};
+
+// Packs meshes of one vertex format into a shared vertex buffer and a shared
+// index buffer, so a whole pass can run off one VAO and draws differ only in
+// their ranges. Indices stay relative to their own mesh.
+class MeshPool
+{
+public:
+  unsigned int vertexBuffer;
+  unsigned int indexBuffer;
+
+  explicit MeshPool(const VertexFormat &format);
+  // a pool that stores meshes compressed: add() takes them in the
+  // quantizer's source format, the buffers hold its compressed format
+  explicit MeshPool(const VertexQuantizer &quantizer);
+  ~MeshPool();
+  MeshPool(const MeshPool &) = delete;
+  MeshPool &operator=(const MeshPool &) = delete;
+
+  // append a mesh, vertices laid out as the source format. It goes through
+  // MeshProcessor::process() and the quantizer first, indices may be NULL
+  // for a plain triangle list. Returns its range, valid once upload() has
+  // run.
+  MeshRange add(const void* vertices, size_t vertexCount,
+                const unsigned int* indices, size_t indexCount,
+                MeshStats* stats = NULL);
+  // append a mesh that is processed and quantized already
+  MeshRange add(const Mesh &mesh);
+  // append the mesh of file, which has to stay open until upload(). Its
+  // stream has to be laid out as the pool's format; if not, this prints why
+  // and returns an empty range.
+  MeshRange add(const MeshFile &file);
+  // fill the GL buffers with everything added, straight from where it
+  // lives. Call it once, after the last add().
+  void upload();
+
+  // the vertex buffer and its layout, for VertexArrayCache together with
+  // indexBuffer
+  VertexStream getStream() const;
+
+private:
+  // a mesh waiting for upload(), in memory the pool doesn't own
+  struct Part
+  {
+    const void* vertices;
+    size_t vertexBytes;
+    const unsigned int* indices;
+    size_t indexCount;
+  };
+
+  VertexQuantizer quantizer;
+  std::vector<Part> parts;
+  // the meshes the pool processed itself, a deque keeps them in place
+  std::deque<Mesh> meshes;
+  size_t vertexBytes;
+  size_t indexCount;
+
+  MeshRange addPart(const Part &part);
+};
+#endif
@@ -0,0 +1,208 @@
+#include "mesh_processor.h"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+size_t Mesh::getVertexCount() const
+{
+  return stride > 0 ? vertices.size() / stride : 0;
+}
+
+Mesh MeshProcessor::process(const void* vertices, size_t vertexCount,
+                            size_t stride, const unsigned int* indices,
+                            size_t indexCount, MeshStats* stats)
+{
+  Mesh mesh = weld(vertices, vertexCount, stride, indices, indexCount);
+  if (stats) {
+    stats->verticesBefore = vertexCount;
+    // without indices every corner is a vertex of its own
+    stats->acmrBefore =
+        indices ? computeACMR(indices, indexCount) : (vertexCount ? 3.0f : 0.0f);
+  }
+  optimizeVertexCache(mesh);
+  if (stats) {
+    stats->verticesAfter = mesh.getVertexCount();
+    stats->acmrAfter = computeACMR(mesh.indices.data(), mesh.indices.size());
+  }
+  return mesh;
+}
+
+Mesh MeshProcessor::weld(const void* vertices, size_t vertexCount,
+                         size_t stride, const unsigned int* indices,
+                         size_t indexCount)
+{
+  Mesh mesh;
+  mesh.stride = stride;
+  const unsigned char* bytes = (const unsigned char*)vertices;
+  // whole triangles only, a trailing partial one is dropped
+  size_t count = (indices ? indexCount : vertexCount) / 3 * 3;
+  mesh.indices.reserve(count);
+
+  // vertex bytes -> new index. Equal bytes only, so vertices that differ in
+  // any attribute (a UV seam, a hard edge) stay apart.
+  std::unordered_map<std::string, unsigned int> unique;
+  size_t dropped = 0;
+  for (size_t first = 0; first < count; first += 3) {
+    // a triangle with a corner past the vertices goes as a whole, or every
+    // later index would end up in the wrong triangle
+    size_t sources[3];
+    bool valid = true;
+    for (int corner = 0; corner < 3; corner++) {
+      sources[corner] = indices ? indices[first + corner] : first + corner;
+      valid = valid && sources[corner] < vertexCount;
+    }
+    if (!valid) {
+      dropped++;
+      continue;
+    }
+    for (int corner = 0; corner < 3; corner++) {
+      const unsigned char* vertex = bytes + sources[corner] * stride;
+      std::pair<std::unordered_map<std::string, unsigned int>::iterator, bool>
+          inserted = unique.insert(std::make_pair(
+              std::string((const char*)vertex, stride),
+              (unsigned int)mesh.getVertexCount()));
+      if (inserted.second)
+        mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + stride);
+      mesh.indices.push_back(inserted.first->second);
+    }
+  }
+  if (dropped > 0)
+    std::cout << "ERROR::MESH_PROCESSOR::INDEX_OUT_OF_RANGE dropped "
+              << dropped << " triangles" << std::endl;
+  return mesh;
+}
+
+void MeshProcessor::optimizeVertexCache(Mesh &mesh, unsigned int cacheSize)
+{
+  mesh.indices = tipsify(mesh.indices, mesh.getVertexCount(), cacheSize);
+  reorderVertices(mesh);
+}
+
+float MeshProcessor::computeACMR(const unsigned int* indices,
+                                 size_t indexCount, unsigned int cacheSize)
+{
+  size_t triangles = indexCount / 3;
+  if (triangles == 0)
+    return 0.0f;
+
+  // a vertex is in the cache if it was pushed less than cacheSize misses ago
+  std::unordered_map<unsigned int, size_t> pushedAt;
+  size_t misses = 0;
+  for (size_t i = 0; i < triangles * 3; i++) {
+    std::unordered_map<unsigned int, size_t>::iterator it =
+        pushedAt.find(indices[i]);
+    if (it == pushedAt.end() || misses - it->second >= cacheSize) {
+      pushedAt[indices[i]] = misses;
+      misses++;
+    }
+  }
+  return (float)misses / triangles;
+}
+
+std::vector<unsigned int>
+MeshProcessor::tipsify(const std::vector<unsigned int> &indices,
+                       size_t vertexCount, unsigned int cacheSize)
+{
+  size_t triangleCount = indices.size() / 3;
+
+  // vertex -> triangles using it, as offsets into one array
+  std::vector<unsigned int> live(vertexCount, 0);
+  for (size_t i = 0; i < triangleCount * 3; i++)
+    live[indices[i]]++;
+  std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; v++)
+    firstTriangle[v + 1] = firstTriangle[v] + live[v];
+  std::vector<unsigned int> adjacency(firstTriangle[vertexCount]);
+  std::vector<size_t> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+  for (size_t t = 0; t < triangleCount; t++)
+    for (int corner = 0; corner < 3; corner++)
+      adjacency[filled[indices[t * 3 + corner]]++] = (unsigned int)t;
+
+  // cacheTime[v]: the time v entered the cache; v is still cached while
+  // time - cacheTime[v] <= cacheSize
+  std::vector<size_t> cacheTime(vertexCount, 0);
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<unsigned int> deadEnds;
+  std::vector<unsigned int> result;
+  result.reserve(triangleCount * 3);
+  size_t time = cacheSize + 1;
+  size_t cursor = 0;
+  long fan = vertexCount > 0 ? 0 : -1;
+
+  while (fan >= 0) {
+    // emit every remaining triangle around the fanning vertex
+    std::vector<unsigned int> candidates;
+    for (size_t a = firstTriangle[fan]; a < firstTriangle[fan + 1]; a++) {
+      unsigned int t = adjacency[a];
+      if (emitted[t])
+        continue;
+      for (int corner = 0; corner < 3; corner++) {
+        unsigned int v = indices[t * 3 + corner];
+        result.push_back(v);
+        deadEnds.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - cacheTime[v] > cacheSize)
+          cacheTime[v] = time++;
+      }
+      emitted[t] = true;
+    }
+
+    // next fan: the candidate that stays cached longest while its remaining
+    // triangles are emitted
+    fan = -1;
+    long best = -1;
+    for (unsigned int v : candidates) {
+      if (live[v] == 0)
+        continue;
+      long priority = 0;
+      if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+        priority = (long)(time - cacheTime[v]);
+      if (priority > best) {
+        best = priority;
+        fan = v;
+      }
+    }
+    if (fan >= 0)
+      continue;
+
+    // dead end: a recently used vertex with work left, else the next one in
+    // input order
+    while (!deadEnds.empty() && fan < 0) {
+      unsigned int v = deadEnds.back();
+      deadEnds.pop_back();
+      if (live[v] > 0)
+        fan = v;
+    }
+    while (fan < 0 && cursor < vertexCount) {
+      if (live[cursor] > 0)
+        fan = (long)cursor;
+      cursor++;
+    }
+  }
+  return result;
+}
+
+void MeshProcessor::reorderVertices(Mesh &mesh)
+{
+  size_t vertexCount = mesh.getVertexCount();
+  const unsigned int unused = ~0u;
+  std::vector<unsigned int> remap(vertexCount, unused);
+  std::vector<unsigned char> vertices;
+  vertices.reserve(mesh.vertices.size());
+
+  // number the vertices in the order the draw first touches them; vertices
+  // no triangle uses are dropped
+  unsigned int next = 0;
+  for (unsigned int &index : mesh.indices) {
+    if (remap[index] == unused) {
+      remap[index] = next++;
+      const unsigned char* vertex = &mesh.vertices[index * mesh.stride];
+      vertices.insert(vertices.end(), vertex, vertex + mesh.stride);
+    }
+    index = remap[index];
+  }
+  mesh.vertices.swap(vertices);
+}
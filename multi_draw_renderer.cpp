@@ -0,0 +1,128 @@
+#include "multi_draw_renderer.h"
+#include "gl_state.h"
+#include "shader.h"
+
+#include <cstring>
+
+// passes the rings hold before they wrap onto one GL may still be drawing
+static const size_t FRAMES_IN_FLIGHT = 3;
+
+MultiDrawRenderer::MultiDrawRenderer(const std::string &modelAttribute,
+                                     size_t maxInstances)
+    : modelAttribute(modelAttribute),
+      instances(GL_ARRAY_BUFFER,
+                FRAMES_IN_FLIGHT * maxInstances * sizeof(glm::mat4)),
+      indirect(GL_DRAW_INDIRECT_BUFFER,
+               FRAMES_IN_FLIGHT * MAX_COMMANDS * sizeof(DrawCommand))
+{
+  format.add(modelAttribute, 16, GL_FLOAT).setDivisor(1);
+}
+
+MultiDrawRenderer::~MultiDrawRenderer() {}
+
+bool MultiDrawRenderer::isSupported()
+{
+  return GLAD_GL_VERSION_4_3 != 0;
+}
+
+VertexStream MultiDrawRenderer::getStream() const
+{
+  VertexStream stream = {&format, instances.ID};
+  return stream;
+}
+
+void MultiDrawRenderer::begin()
+{
+  commands.clear();
+}
+
+glm::mat4* MultiDrawRenderer::add(const MeshRange &mesh, size_t count)
+{
+  // the indirect ring holds MAX_COMMANDS per pass, one more and submit()
+  // couldn't allocate the pass at all
+  if (count == 0 || commands.size() >= MAX_COMMANDS)
+    return NULL;
+  // matrix aligned, so the offset is a whole number of instances
+  size_t offset;
+  void* models = instances.allocate(count * sizeof(glm::mat4),
+                                    sizeof(glm::mat4), offset);
+  if (!models)
+    return NULL;
+
+  DrawCommand command;
+  command.count = mesh.indexCount;
+  command.instanceCount = (GLuint)count;
+  command.firstIndex = mesh.firstIndex;
+  command.baseVertex = mesh.baseVertex;
+  command.baseInstance = (GLuint)(offset / sizeof(glm::mat4));
+  commands.push_back(command);
+  return (glm::mat4*)models;
+}
+
+size_t MultiDrawRenderer::getDrawCount() const
+{
+  return commands.size();
+}
+
+void MultiDrawRenderer::submit(const Shader &shader, GLenum mode)
+{
+  if (commands.empty())
+    return;
+  instances.flush();
+
+  size_t offset;
+  size_t size = commands.size() * sizeof(DrawCommand);
+  void* command = isSupported() ? indirect.allocate(size, 4, offset) : NULL;
+  if (command) {
+    // the whole pass in one call, the GPU walks the commands
+    memcpy(command, commands.data(), size);
+    indirect.flush();
+    GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect.ID);
+    glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, (const void*)offset,
+                                (GLsizei)commands.size(), 0);
+    indirect.fence();
+    instances.fence();
+    return;
+  }
+
+  // without base instance draws (GL 4.2) the model matrix input is moved to
+  // each command's matrices by hand, and moved back afterwards since the VAO
+  // is shared
+  bool baseInstance = GLAD_GL_VERSION_4_2 != 0;
+  int location = -1;
+  if (!baseInstance)
+    for (const Shader::Variable &input : shader.getAttributes())
+      if (input.name == modelAttribute)
+        location = input.location;
+
+  for (const DrawCommand &command : commands) {
+    const void* indices =
+        (const void*)(command.firstIndex * sizeof(unsigned int));
+    if (baseInstance) {
+      glDrawElementsInstancedBaseVertexBaseInstance(
+          mode, command.count, GL_UNSIGNED_INT, indices,
+          command.instanceCount, command.baseVertex, command.baseInstance);
+    } else {
+      pointModels(location, command.baseInstance);
+      glDrawElementsInstancedBaseVertex(mode, command.count, GL_UNSIGNED_INT,
+                                        indices, command.instanceCount,
+                                        command.baseVertex);
+    }
+  }
+  if (!baseInstance)
+    pointModels(location, 0);
+  instances.fence();
+}
+
+void MultiDrawRenderer::pointModels(int location, GLuint first)
+{
+  if (location < 0)
+    return;
+  GLState::bindBuffer(GL_ARRAY_BUFFER, instances.ID);
+  // one location per column, like VertexArrayCache sets them up
+  for (int column = 0; column < 4; column++)
+    glVertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE,
+                          sizeof(glm::mat4),
+                          (const void*)(first * sizeof(glm::mat4) +
+                                        column * sizeof(glm::vec4)));
+}
@@ -0,0 +1,73 @@
+#ifndef MULTI_DRAW_RENDERER_H
+#define MULTI_DRAW_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "mesh_pool.h"
+#include "stream_buffer.h"
+#include "vertex_format.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Shader;
+
+// Submits a whole pass of different meshes from one MeshPool with a single
+// glMultiDrawElementsIndirect. Every add() becomes one indirect command that
+// draws a mesh once per model matrix. The matrices are written straight into
+// a StreamBuffer and each command's baseInstance points at its own. Without
+// GL 4.3 the same commands are drawn one by one.
+class MultiDrawRenderer
+{
+public:
+  // add() calls per pass, each is one indirect command
+  static const size_t MAX_COMMANDS = 256;
+
+  // modelAttribute names the mat4 input of the vertex shader. At most
+  // maxInstances matrices can be added per pass.
+  MultiDrawRenderer(const std::string &modelAttribute, size_t maxInstances);
+  ~MultiDrawRenderer();
+  MultiDrawRenderer(const MultiDrawRenderer &) = delete;
+  MultiDrawRenderer &operator=(const MultiDrawRenderer &) = delete;
+
+  // true if the context has glMultiDrawElementsIndirect
+  static bool isSupported();
+
+  // the instance buffer and its layout, pass it to VertexArrayCache next to
+  // the pool's stream
+  VertexStream getStream() const;
+  // start collecting a new pass
+  void begin();
+  // draw mesh count times. Returns where to write the count model matrices,
+  // NULL if they don't fit or the pass has MAX_COMMANDS commands already.
+  // Write them before submit().
+  glm::mat4* add(const MeshRange &mesh, size_t count);
+  // upload and draw everything added since begin(), with the VAO built for
+  // shader bound
+  void submit(const Shader &shader, GLenum mode = GL_TRIANGLES);
+  // commands in the current pass
+  size_t getDrawCount() const;
+
+private:
+  // the layout glMultiDrawElementsIndirect reads
+  struct DrawCommand
+  {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
+
+  std::string modelAttribute;
+  VertexFormat format;
+  StreamBuffer instances;
+  StreamBuffer indirect;
+  std::vector<DrawCommand> commands;
+
+  // point the model matrix input at the instance buffer from instance
+  // first on, for contexts without base instance draws
+  void pointModels(int location, GLuint first);
+};
+#endif
@@ -0,0 +1,166 @@
+#include "program_cache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace {
+// file layout: magic, binary format, binary length, binary
+const uint32_t CACHE_MAGIC = 0x42504c47; // "GLPB"
+
+struct CacheHeader
+{
+  uint32_t magic;
+  uint32_t format;
+  uint32_t length;
+};
+
+std::string glString(GLenum name)
+{
+  const GLubyte* value = glGetString(name);
+  return value ? std::string((const char*)value) : std::string();
+}
+}
+
+std::string ProgramCache::directory = "shader-cache";
+
+void ProgramCache::setDirectory(const std::string &dir)
+{
+  directory = dir;
+}
+
+const std::string &ProgramCache::getDirectory()
+{
+  return directory;
+}
+
+bool ProgramCache::isSupported()
+{
+  if (directory.empty() || !GLAD_GL_VERSION_4_1)
+    return false;
+  int formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  return formats > 0;
+}
+
+std::string ProgramCache::makeKey(const ShaderSource &vertexCode,
+                                  const ShaderSource &fragmentCode)
+{
+  std::string driver = glString(GL_VENDOR) + '\n' + glString(GL_RENDERER) +
+                       '\n' + glString(GL_VERSION);
+  // hash the lengths too so moving text between the stages changes the key
+  uint64_t lengths[2] = {vertexCode.size(), fragmentCode.size()};
+  uint64_t hash = hashBytes(lengths, sizeof(lengths));
+  // hashing piece by piece gives the same key as the joined text
+  for (GLsizei i = 0; i < vertexCode.count(); i++)
+    hash = hashBytes(vertexCode.strings()[i], vertexCode.lengths()[i], hash);
+  for (GLsizei i = 0; i < fragmentCode.count(); i++)
+    hash = hashBytes(fragmentCode.strings()[i], fragmentCode.lengths()[i],
+                     hash);
+  hash = hashBytes(driver.data(), driver.size(), hash);
+
+  char key[17];
+  std::snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+  return key;
+}
+
+std::string ProgramCache::pathFor(const std::string &key)
+{
+  return directory + "/" + key + ".bin";
+}
+
+unsigned int ProgramCache::load(const std::string &key)
+{
+  if (!isSupported())
+    return 0;
+
+  std::ifstream file(pathFor(key).c_str(), std::ios::binary);
+  if (!file)
+    return 0;
+
+  CacheHeader header;
+  if (!file.read((char*)&header, sizeof(header)) ||
+      header.magic != CACHE_MAGIC || header.length == 0)
+    return 0;
+  std::vector<char> binary(header.length);
+  if (!file.read(binary.data(), binary.size()))
+    return 0;
+
+  unsigned int program = glCreateProgram();
+  glProgramBinary(program, header.format, binary.data(), header.length);
+
+  // the driver is free to reject a binary, e.g. after an update that kept
+  // the version string
+  int success = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    glDeleteProgram(program);
+    std::remove(pathFor(key).c_str());
+    return 0;
+  }
+  return program;
+}
+
+void ProgramCache::prepare(unsigned int program)
+{
+  if (isSupported())
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramCache::store(const std::string &key, unsigned int program)
+{
+  if (!isSupported())
+    return;
+
+  int length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+
+  if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    std::cout << "ERROR::PROGRAM_CACHE::CANNOT_CREATE_DIRECTORY " << directory
+              << std::endl;
+    return;
+  }
+
+  // write to a temporary file of our own and rename it into place, so a
+  // concurrent process never reads a half written binary, and two that
+  // store the same key don't write into one file
+  std::string path = pathFor(key);
+  std::vector<char> tmpPath(path.begin(), path.end());
+  const char SUFFIX[] = ".XXXXXX";
+  tmpPath.insert(tmpPath.end(), SUFFIX, SUFFIX + sizeof(SUFFIX));
+  int fd = mkstemp(tmpPath.data());
+  if (fd < 0) {
+    std::cout << "ERROR::PROGRAM_CACHE::CANNOT_WRITE " << path << std::endl;
+    return;
+  }
+  // mkstemp creates it private, a cache entry is readable like any file
+  fchmod(fd, 0644);
+  FILE* file = fdopen(fd, "wb");
+  if (!file) {
+    close(fd);
+    std::remove(tmpPath.data());
+    return;
+  }
+  CacheHeader header = {CACHE_MAGIC, format, (uint32_t)length};
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(binary.data(), length, 1, file) == 1;
+  // the data may only reach the disk on close, so that is checked too
+  written = fclose(file) == 0 && written;
+  if (!written || std::rename(tmpPath.data(), path.c_str()) != 0) {
+    std::cout << "ERROR::PROGRAM_CACHE::CANNOT_WRITE " << path << std::endl;
+    std::remove(tmpPath.data());
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+#include "hash.h"
+#include "shader_source.h"
+
+#include <cstdint>
+#include <string>
+
+// Persistent on-disk cache of linked program binaries. Entries are keyed by
+// a hash of the shader sources and the driver vendor/renderer/version, so a
+// driver update simply misses the cache instead of loading a stale binary.
+class ProgramCache
+{
+public:
+  // directory the binaries live in, an empty string disables the cache
+  static void setDirectory(const std::string &dir);
+  static const std::string &getDirectory();
+
+  // true if the context can save and load program binaries at all
+  static bool isSupported();
+
+  // cache key of a vertex/fragment pair for the current context
+  static std::string makeKey(const ShaderSource &vertexCode,
+                             const ShaderSource &fragmentCode);
+
+  // create a program from a cached binary. Returns 0 on a miss or if the
+  // driver rejected the binary, the caller then compiles from source.
+  static unsigned int load(const std::string &key);
+  // call before glLinkProgram so the driver keeps the binary around
+  static void prepare(unsigned int program);
+  // save the binary of a successfully linked program
+  static void store(const std::string &key, unsigned int program);
+
+private:
+  static std::string directory;
+  static std::string pathFor(const std::string &key);
+};
+#endif
@@ -9,8 +9,21 @@ uniform sampler2D texture1;
 uniform sampler2D texture2;
 uniform float mixValue;
 
+// feature keys, defined per variant by ShaderVariants. Built without any of
+// them the shader mixes both textures.
+#if !defined(SAMPLE_TEXTURE1) && !defined(SAMPLE_TEXTURE2)
+#define SAMPLE_TEXTURE1
+#define SAMPLE_TEXTURE2
+#endif
+
 void main()
 {
   vec2 TexCoordFlippedHorizontal = vec2(-TexCoord.x, TexCoord.y);
+#if defined(SAMPLE_TEXTURE1) && defined(SAMPLE_TEXTURE2)
   FragColor= mix(texture(texture1, TexCoord), texture(texture2, TexCoordFlippedHorizontal), mixValue);
+#elif defined(SAMPLE_TEXTURE2)
+  FragColor= texture(texture2, TexCoordFlippedHorizontal);
+#else
+  FragColor= texture(texture1, TexCoord);
+#endif
 }
@@ -1,17 +1,27 @@
 #version 330 core
+// quantized, see VertexQuantizer. The fetch turns snorm16 positions and
+// unorm16 coordinates into floats, aModel undoes the position scale/bias.
 layout ( location=0 ) in vec3 aPos;
 layout ( location=1 ) in vec2 aTexCoord;
+// per instance, see MultiDrawRenderer. Takes locations 2 to 5.
+layout ( location=2 ) in mat4 aModel;
 
 out vec3 ourColor;
 out vec2 TexCoord;
 
 uniform mat4 transform;
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// scale in xy, bias in zw, see MeshDecode
+uniform vec4 texCoordDecode = vec4(1.0, 1.0, 0.0, 0.0);
+
+// shared by every program, uploaded once per frame
+layout (std140) uniform CameraMatrices
+{
+  mat4 projection;
+  mat4 view;
+};
 
 void main()
 {
-  gl_Position = projection * view * model * vec4(aPos, 1.0);
-  TexCoord = vec2(aTexCoord.x, aTexCoord.y);
+  gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+  TexCoord = aTexCoord * texCoordDecode.xy + texCoordDecode.zw;
 }
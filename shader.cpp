@@ -1,45 +1,433 @@
 #include "shader.h"
+#include "gl_state.h"
+#include "program_cache.h"
+#include "shader_preprocessor.h"
+#include "shader_watcher.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
-{
-  //1. retrieve the vertex/fragment source code from filePath
-  std::string vertexCode;
-  std::string fragmentCode;
-  std::ifstream vShaderFile;
-  std::ifstream fShaderFile;
-  // ensure ifstream objects can throw exceptions
-  vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  try
-  {
-    // open files
-    vShaderFile.open(vertexPath);
-    fShaderFile.open(fragmentPath);
-    std::stringstream vShaderStream, fShaderStream;
-    // read file's buffer contents into streams
-    vShaderStream << vShaderFile.rdbuf();
-    fShaderStream << fShaderFile.rdbuf();
-    // close file handlers
-    vShaderFile.close();
-    fShaderFile.close();
-    // convert stream into string
-    vertexCode = vShaderStream.str();
-    fragmentCode = fShaderStream.str();
-  } catch (std::ifstream::failure e) {
-    std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
-  }
-  const char* vShaderCode = vertexCode.c_str();
-  const char* fShaderCode = fragmentCode.c_str();
-
-  //2. compile shaders
-  unsigned int vertex, fragment;
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+// not in the generated glad header, shared by the KHR and ARB extensions
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// everything that belongs to one GL program rather than to a handle
+struct Shader::Program
+{
+  unsigned int ID;
+  // the registry entry, empty if the program isn't registered
+  std::string key;
+  // what the program was first built from. Shaders that share it may have
+  // named other files with the same text; the first one gets watched.
+  ShaderDesc desc;
+  // every file the sources were built from, includes too
+  std::vector<std::string> dependencies;
+  std::unique_ptr<ShaderWatcher> watcher;
+  std::vector<Variable> attributes;
+  std::vector<Variable> uniforms;
+  // uniform name -> location, filled after every link
+  std::unordered_map<std::string, int> uniformLocations;
+  // indexed by uniform handle, grown on demand
+  std::vector<UniformSlot> uniformSlots;
+
+  // where a lazily built program is, see Shader::setLazyCompile()
+  enum State { QUEUED, ISSUED, READY };
+  State state;
+  // kept until the program is issued
+  ShaderSource vertexCode;
+  ShaderSource fragmentCode;
+  // the stages of an issued program
+  unsigned int vertex;
+  unsigned int fragment;
+
+  Program() : ID(0), state(READY), vertex(0), fragment(0) {}
+  ~Program();
+  // start building: load the binary or issue the compiles and the link
+  void issue();
+  // true if finish() won't wait for the driver
+  bool poll() const;
+  // wait for the link and take the program into use
+  void finish();
+  // called whenever ID holds a newly linked program
+  void linked();
+  // enumerate the active attributes and uniforms of the linked program
+  void cacheAttributes();
+  void cacheUniformLocations();
+  int findUniformLocation(const std::string &name) const;
+  // drop the registry entry if it still refers to this program
+  void unregister();
+};
+
+bool Shader::parallelCompile = false;
+bool Shader::lazyCompile = false;
+std::unordered_map<std::string, unsigned int> Shader::blockBindings;
+Shader::UniformStats Shader::uniformStats;
+std::unordered_map<std::string, std::weak_ptr<Shader::Program> >
+    Shader::programs;
+std::vector<std::weak_ptr<Shader::Program> > Shader::compileQueue;
+std::unordered_map<std::string, int> Shader::uniformHandles;
+std::vector<std::string> Shader::uniformNames;
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath,
+               const std::vector<std::string> &defines)
+{
+  ShaderDesc desc;
+  desc.vertexPath = vertexPath;
+  desc.fragmentPath = fragmentPath;
+  desc.defines = defines;
+
+  //1. retrieve the vertex/fragment source code from filePath, with the
+  //   includes resolved and the defines injected
+  ShaderSource vertexCode;
+  ShaderSource fragmentCode;
+  std::vector<std::string> dependencies;
+  loadSources(desc, vertexCode, fragmentCode, &dependencies);
+
+  //2. share the program if these sources were built already, otherwise
+  //   compile and link, or load it from the binary cache
+  std::string cacheKey = ProgramCache::makeKey(vertexCode, fragmentCode);
+  program = findProgram(cacheKey);
+  if (!program && lazyCompile)
+    program = queueProgram(cacheKey, desc, dependencies, vertexCode,
+                           fragmentCode);
+  else if (!program)
+    program = addProgram(cacheKey, desc, dependencies,
+                         buildProgram(vertexCode, fragmentCode, cacheKey));
+}
+
+Shader::Shader(const std::shared_ptr<Program> &program)
+    : program(program)
+{
+}
+
+Shader::Shader(const EmbeddedShader &vertex, const EmbeddedShader &fragment,
+               const std::vector<std::string> &defines)
+    : Shader(addEmbedded(vertex), addEmbedded(fragment), defines)
+{
+}
+
+const char* Shader::addEmbedded(const EmbeddedShader &shader)
+{
+  ShaderPreprocessor::addEmbedded(&shader, 1);
+  return shader.name;
+}
+
+Shader::Program::~Program()
+{
+  // stop the watcher thread before the program goes away
+  watcher.reset();
+  if (state == ISSUED) {
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+  }
+  glDeleteProgram(ID);
+  unregister();
+}
+
+void Shader::Program::unregister()
+{
+  if (key.empty())
+    return;
+  // a dying program's weak_ptr has already expired
+  std::unordered_map<std::string, std::weak_ptr<Program> >::iterator it =
+      programs.find(key);
+  if (it != programs.end() &&
+      (it->second.expired() || it->second.lock().get() == this))
+    programs.erase(it);
+  key.clear();
+}
+
+std::shared_ptr<Shader::Program> Shader::findProgram(const std::string &key)
+{
+  std::unordered_map<std::string, std::weak_ptr<Program> >::const_iterator it =
+      programs.find(key);
+  return it != programs.end() ? it->second.lock() : std::shared_ptr<Program>();
+}
+
+std::shared_ptr<Shader::Program>
+Shader::addProgram(const std::string &key, const ShaderDesc &desc,
+                   const std::vector<std::string> &dependencies,
+                   unsigned int id)
+{
+  std::shared_ptr<Program> program(new Program());
+  program->ID = id;
+  program->desc = desc;
+  program->dependencies = dependencies;
+  program->linked();
+  // a failed build isn't shared, the next Shader asking for it retries
+  if (id != 0) {
+    program->key = key;
+    programs[key] = program;
+  }
+  return program;
+}
+
+std::shared_ptr<Shader::Program>
+Shader::queueProgram(const std::string &key, const ShaderDesc &desc,
+                     const std::vector<std::string> &dependencies,
+                     const ShaderSource &vertexCode,
+                     const ShaderSource &fragmentCode)
+{
+  // registered right away, so duplicates share it before it is built
+  std::shared_ptr<Program> program(new Program());
+  program->state = Program::QUEUED;
+  program->vertexCode = vertexCode;
+  program->fragmentCode = fragmentCode;
+  program->desc = desc;
+  program->dependencies = dependencies;
+  program->key = key;
+  programs[key] = program;
+  compileQueue.push_back(program);
+  return program;
+}
+
+void Shader::setLazyCompile(bool lazy)
+{
+  lazyCompile = lazy;
+}
+
+size_t Shader::compilePending(double budgetMs)
+{
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  std::vector<std::weak_ptr<Program> > queued;
+  for (const std::weak_ptr<Program> &entry : compileQueue) {
+    std::shared_ptr<Program> program = entry.lock();
+    // gone, or built on the spot because it was used early
+    if (!program || program->state == Program::READY)
+      continue;
+
+    // issue on one frame, collect on a later one once the driver is done
+    double elapsed = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    if (elapsed < budgetMs) {
+      if (program->state == Program::QUEUED)
+        program->issue();
+      else if (program->poll())
+        program->finish();
+    }
+    if (program->state != Program::READY)
+      queued.push_back(program);
+  }
+  compileQueue.swap(queued);
+  return compileQueue.size();
+}
+
+void Shader::Program::issue()
+{
+  // a file may have been edited while the program was queued. Expand it
+  // again, so the mappings aren't read and the binary cache entry matches
+  // what is built; duplicates of the old sources no longer share it.
+  if (!vertexCode.isCurrent() || !fragmentCode.isCurrent()) {
+    loadSources(desc, vertexCode, fragmentCode, &dependencies);
+    unregister();
+    key = ProgramCache::makeKey(vertexCode, fragmentCode);
+  }
+
+  // a binary from a previous run needs no compiler at all
+  ID = ProgramCache::load(key);
+  if (ID != 0) {
+    state = READY;
+    linked();
+  } else {
+    vertex = compileStage(GL_VERTEX_SHADER, vertexCode);
+    fragment = compileStage(GL_FRAGMENT_SHADER, fragmentCode);
+    ID = linkStages(vertex, fragment);
+    state = ISSUED;
+  }
+  vertexCode = ShaderSource();
+  fragmentCode = ShaderSource();
+}
+
+bool Shader::Program::poll() const
+{
+  if (state != ISSUED)
+    return state == READY;
+  // without the extension there is no way to ask, the status queries in
+  // finish() simply block
+  if (!parallelCompile)
+    return true;
+  int complete = 0;
+  glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+  return complete != 0;
+}
+
+void Shader::Program::finish()
+{
+  if (state == QUEUED)
+    issue();
+  if (state != ISSUED)
+    return;
+
+  ID = finishProgram(ID, vertex, fragment);
+  vertex = fragment = 0;
+  state = READY;
+  // a failed build isn't shared, the next Shader asking for it retries
+  if (ID != 0)
+    ProgramCache::store(key, ID);
+  else
+    unregister();
+  linked();
+}
+
+void Shader::ensureReady() const
+{
+  if (program->state != Program::READY)
+    program->finish();
+}
+
+bool Shader::isReady() const
+{
+  return program->state == Program::READY;
+}
+
+bool Shader::loadSources(const ShaderDesc &desc, ShaderSource &vertexCode,
+                         ShaderSource &fragmentCode,
+                         std::vector<std::string>* dependencies)
+{
+  std::vector<std::string> vertexFiles, fragmentFiles;
+  bool loaded =
+      ShaderPreprocessor::expand(desc.vertexPath, desc.defines, vertexCode,
+                                 &vertexFiles) &&
+      ShaderPreprocessor::expand(desc.fragmentPath, desc.defines,
+                                 fragmentCode, &fragmentFiles);
+  if (dependencies) {
+    dependencies->swap(vertexFiles);
+    for (const std::string &file : fragmentFiles)
+      if (std::find(dependencies->begin(), dependencies->end(), file) ==
+          dependencies->end())
+        dependencies->push_back(file);
+  }
+  return loaded;
+}
+
+void Shader::watch()
+{
+  // every handle to the program shares one watcher
+  if (program->watcher)
+    return;
+
+  // the loader runs on the watcher thread, so it gets its own copy of the
+  // description. Includes are watched as well.
+  ShaderDesc watched = program->desc;
+  std::vector<std::string> files;
+  for (const std::string &file : program->dependencies)
+    if (!ShaderPreprocessor::isEmbedded(file))
+      files.push_back(file);
+  if (files.empty())
+    return;
+  program->watcher.reset(new ShaderWatcher(files,
+      [watched](std::vector<std::string> &sources) {
+        ShaderSource vertexCode, fragmentCode;
+        if (!loadSources(watched, vertexCode, fragmentCode, NULL))
+          return false;
+        // the watcher hands the text across threads, take a plain copy
+        sources.push_back(vertexCode.str());
+        sources.push_back(fragmentCode.str());
+        return true;
+      }));
+}
+
+bool Shader::reload()
+{
+  // the first handle to ask takes the sources, the swap is seen by all
+  ensureReady();
+  Program &shared = *program;
+  std::vector<std::string> sources;
+  if (!shared.watcher || !shared.watcher->takeSources(sources))
+    return false;
+
+  ShaderSource vertexCode(sources[0]), fragmentCode(sources[1]);
+  std::string cacheKey = ProgramCache::makeKey(vertexCode, fragmentCode);
+  unsigned int id = buildProgram(vertexCode, fragmentCode, cacheKey);
+  if (id == 0) {
+    // the errors were printed already, keep drawing with the old program
+    std::cout << "SHADER::RELOAD::KEEPING_PREVIOUS_PROGRAM" << std::endl;
+    return false;
+  }
+
+  // swap the new program in, staying bound if the old one was
+  int current = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+  bool wasBound = (unsigned int)current == shared.ID;
+  glDeleteProgram(shared.ID);
+  shared.ID = id;
+  shared.linked();
+  if (wasBound)
+    GLState::useProgram(id);
+
+  // file it under the new sources, unless another program already has them
+  shared.unregister();
+  if (!findProgram(cacheKey)) {
+    shared.key = cacheKey;
+    programs[cacheKey] = program;
+  }
+  return true;
+}
+
+unsigned int Shader::buildProgram(const ShaderSource &vertexCode,
+                                  const ShaderSource &fragmentCode,
+                                  const std::string &cacheKey)
+{
+  // a binary from a previous run skips compiling and linking entirely
+  unsigned int program = ProgramCache::load(cacheKey);
+  if (program != 0)
+    return program;
+
+  program = compileProgram(vertexCode, fragmentCode);
+  if (program != 0)
+    ProgramCache::store(cacheKey, program);
+  return program;
+}
+
+unsigned int Shader::compileProgram(const ShaderSource &vShaderCode,
+                                    const ShaderSource &fShaderCode)
+{
+  unsigned int vertex = compileStage(GL_VERTEX_SHADER, vShaderCode);
+  unsigned int fragment = compileStage(GL_FRAGMENT_SHADER, fShaderCode);
+  unsigned int program = linkStages(vertex, fragment);
+  return finishProgram(program, vertex, fragment);
+}
+
+unsigned int Shader::compileStage(GLenum type, const ShaderSource &code)
+{
+  // the pieces go to the driver as they are, straight from the mappings.
+  // A file edited since it was mapped no longer holds them, and reading it
+  // may crash: that stage fails instead, hot reload picks up the edit.
+  unsigned int shader = glCreateShader(type);
+  if (code.isCurrent()) {
+    glShaderSource(shader, code.count(), code.strings(), code.lengths());
+  } else {
+    const GLchar* changed =
+        "#error the source changed on disk before it was compiled\n";
+    glShaderSource(shader, 1, &changed, NULL);
+  }
+  glCompileShader(shader);
+  return shader;
+}
+
+unsigned int Shader::linkStages(unsigned int vertex, unsigned int fragment)
+{
+  // shader Program
+  unsigned int program = glCreateProgram();
+  ProgramCache::prepare(program);
+  glAttachShader(program, vertex);
+  glAttachShader(program, fragment);
+  glLinkProgram(program);
+  return program;
+}
+
+unsigned int Shader::finishProgram(unsigned int program, unsigned int vertex,
+                                   unsigned int fragment)
+{
+  // the status queries below wait for the compiler, so they are only made
+  // once everything has been issued
   int success;
   char infoLog[512];
 
-  // vertex shader
-  vertex = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex, 1, &vShaderCode, NULL);
-  glCompileShader(vertex);
   // print compile errors if any
   glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
   if(!success)
@@ -47,27 +435,16 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
     glGetShaderInfoLog(vertex, 512, NULL, infoLog);
     std::cout << "EROOR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
   }
-
-  // fragment shader
-  fragment = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment, 1, &fShaderCode, NULL);
-  glCompileShader(fragment);
   glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
   if(!success){
     glGetShaderInfoLog(fragment, 512, NULL, infoLog);
     std::cout << "EROOR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
   }
 
-  // shader Program
-  ID = glCreateProgram();
-  glAttachShader(ID, vertex);
-  glAttachShader(ID, fragment);
-  glLinkProgram(ID);
-
   // print linking errors if any
-  glGetProgramiv(ID, GL_LINK_STATUS, &success);
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
   if(!success){
-    glGetProgramInfoLog(ID, 512, NULL, infoLog);
+    glGetProgramInfoLog(program, 512, NULL, infoLog);
     std::cout << "EROOR::PROGRAM::LINKING::FAILED\n" << infoLog << std::endl;
   }
 
@@ -75,35 +452,393 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
   // longer necessary
   glDeleteShader(vertex);
   glDeleteShader(fragment);
+
+  if(!success){
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+bool Shader::enableParallelCompile(GLADloadproc load)
+{
+  parallelCompile = false;
+  int count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (int i = 0; i < count && !parallelCompile; i++) {
+    const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+    parallelCompile = name && (!strcmp(name, "GL_KHR_parallel_shader_compile") ||
+                               !strcmp(name, "GL_ARB_parallel_shader_compile"));
+  }
+  if (!parallelCompile)
+    return false;
+
+  // glad was generated without extensions, so the entry point is fetched by
+  // hand. Both extensions share the same enums and semantics.
+  typedef void (APIENTRYP MaxCompilerThreadsProc)(GLuint count);
+  MaxCompilerThreadsProc maxCompilerThreads =
+      (MaxCompilerThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+  if (!maxCompilerThreads)
+    maxCompilerThreads =
+        (MaxCompilerThreadsProc)load("glMaxShaderCompilerThreadsARB");
+  // let the driver pick how many threads it uses
+  if (maxCompilerThreads)
+    maxCompilerThreads(0xFFFFFFFFu);
+  return true;
+}
+
+std::vector<std::unique_ptr<Shader> >
+Shader::compileBatch(const std::vector<ShaderDesc> &descs)
+{
+  struct Pending
+  {
+    std::string cacheKey;
+    unsigned int vertex;
+    unsigned int fragment;
+    unsigned int program;
+    bool done;
+    // set if the program is live already
+    std::shared_ptr<Program> shared;
+    // the entry that builds the program, i itself unless it's a duplicate
+    size_t first;
+  };
+  // a lazy batch is only queued, compilePending() overlaps the builds
+  if (lazyCompile) {
+    std::vector<std::unique_ptr<Shader> > shaders;
+    for (const ShaderDesc &desc : descs)
+      shaders.push_back(std::unique_ptr<Shader>(new Shader(
+          desc.vertexPath.c_str(), desc.fragmentPath.c_str(), desc.defines)));
+    return shaders;
+  }
+
+  std::vector<Pending> pending(descs.size());
+  std::vector<std::vector<std::string> > dependencies(descs.size());
+  // cache key -> first entry of the batch with those sources
+  std::unordered_map<std::string, size_t> firsts;
+
+  // 1. issue every compile that the registry or the binary cache can't
+  // satisfy, once per distinct pair of sources
+  for (size_t i = 0; i < descs.size(); i++) {
+    ShaderSource vertexCode, fragmentCode;
+    loadSources(descs[i], vertexCode, fragmentCode, &dependencies[i]);
+
+    Pending &p = pending[i];
+    p.cacheKey = ProgramCache::makeKey(vertexCode, fragmentCode);
+    p.vertex = p.fragment = 0;
+    p.program = 0;
+    p.done = true;
+    p.first = firsts.insert(std::make_pair(p.cacheKey, i)).first->second;
+    if (p.first != i)
+      continue;
+    p.shared = findProgram(p.cacheKey);
+    if (p.shared)
+      continue;
+    p.program = ProgramCache::load(p.cacheKey);
+    p.done = p.program != 0;
+    if (p.done)
+      continue;
+    p.vertex = compileStage(GL_VERTEX_SHADER, vertexCode);
+    p.fragment = compileStage(GL_FRAGMENT_SHADER, fragmentCode);
+  }
+
+  // 2. issue every link, without waiting for the compiles to finish
+  for (Pending &p : pending)
+    if (!p.done)
+      p.program = linkStages(p.vertex, p.fragment);
+
+  // 3. collect the programs in the order the driver finishes them. Without
+  // the extension every query blocks, which degrades to the serial order.
+  size_t remaining = 0;
+  for (const Pending &p : pending)
+    remaining += p.done ? 0 : 1;
+  while (remaining > 0) {
+    for (Pending &p : pending) {
+      if (p.done)
+        continue;
+      int complete = 1;
+      if (parallelCompile)
+        glGetProgramiv(p.program, GL_COMPLETION_STATUS_KHR, &complete);
+      if (!complete)
+        continue;
+
+      p.program = finishProgram(p.program, p.vertex, p.fragment);
+      if (p.program != 0)
+        ProgramCache::store(p.cacheKey, p.program);
+      p.done = true;
+      remaining--;
+    }
+    if (remaining > 0)
+      std::this_thread::yield();
+  }
+
+  // duplicates share the program of their first entry
+  std::vector<std::unique_ptr<Shader> > shaders;
+  for (size_t i = 0; i < descs.size(); i++) {
+    Pending &p = pending[i];
+    if (p.first != i)
+      p.shared = pending[p.first].shared;
+    else if (!p.shared)
+      p.shared = addProgram(p.cacheKey, descs[i], dependencies[i], p.program);
+    shaders.push_back(std::unique_ptr<Shader>(new Shader(p.shared)));
+  }
+  return shaders;
+}
+
+void Shader::Program::linked()
+{
+  cacheAttributes();
+  cacheUniformLocations();
+  bindUniformBlocks(ID);
+}
+
+void Shader::setBlockBinding(const std::string &blockName,
+                             unsigned int binding)
+{
+  blockBindings[blockName] = binding;
+}
+
+void Shader::bindUniformBlock(const std::string &blockName,
+                              unsigned int binding)
+{
+  ensureReady();
+  unsigned int index = glGetUniformBlockIndex(program->ID, blockName.c_str());
+  if (index != GL_INVALID_INDEX)
+    glUniformBlockBinding(program->ID, index, binding);
+}
+
+void Shader::bindUniformBlocks(unsigned int program)
+{
+  int count = 0;
+  int maxLength = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+  std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+
+  // GLSL 330 has no layout(binding=...), so blocks are bound by name here
+  for (int i = 0; i < count; i++) {
+    GLsizei length = 0;
+    glGetActiveUniformBlockName(program, i, (GLsizei)nameBuffer.size(), &length,
+                                nameBuffer.data());
+    std::unordered_map<std::string, unsigned int>::const_iterator it =
+        blockBindings.find(std::string(nameBuffer.data(), length));
+    if (it != blockBindings.end())
+      glUniformBlockBinding(program, i, it->second);
+  }
+}
+
+void Shader::Program::cacheAttributes()
+{
+  attributes.clear();
+
+  int count = 0;
+  int maxLength = 0;
+  glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTES, &count);
+  glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+  std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+
+  for (int i = 0; i < count; i++) {
+    GLsizei length = 0;
+    Variable attribute;
+    glGetActiveAttrib(ID, i, (GLsizei)nameBuffer.size(), &length,
+                      &attribute.size, &attribute.type, nameBuffer.data());
+    attribute.name.assign(nameBuffer.data(), length);
+    attribute.location = glGetAttribLocation(ID, attribute.name.c_str());
+    attributes.push_back(attribute);
+  }
+}
+
+const std::vector<Shader::Variable> &Shader::getAttributes() const
+{
+  ensureReady();
+  return program->attributes;
+}
+
+const std::vector<Shader::Variable> &Shader::getUniforms() const
+{
+  ensureReady();
+  return program->uniforms;
+}
+
+void Shader::Program::cacheUniformLocations()
+{
+  uniformLocations.clear();
+  uniforms.clear();
+
+  int count = 0;
+  int maxLength = 0;
+  glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+  std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+
+  for (int i = 0; i < count; i++) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(ID, i, (GLsizei)nameBuffer.size(), &length, &size,
+                       &type, nameBuffer.data());
+    std::string name(nameBuffer.data(), length);
+    int location = glGetUniformLocation(ID, name.c_str());
+    uniforms.push_back(Variable{name, type, size, location});
+    // members of uniform blocks have no location
+    if (location < 0)
+      continue;
+    uniformLocations[name] = location;
+    // arrays are reported as "name[0]", also make them reachable as "name"
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+      uniformLocations[name.substr(0, name.size() - 3)] = location;
+  }
+
+  // resolve handles again on their next use
+  // a new program starts from its default values, forget the shadows
+  for (UniformSlot &slot : uniformSlots) {
+    slot.resolved = false;
+    slot.shadowSize = 0;
+  }
+}
+
+int Shader::Program::findUniformLocation(const std::string &name) const
+{
+  std::unordered_map<std::string, int>::const_iterator it =
+      uniformLocations.find(name);
+  // -1 is silently ignored by glUniform*, same as an unknown name
+  return it != uniformLocations.end() ? it->second : -1;
+}
+
+int Shader::getUniformHandle(const std::string &name)
+{
+  std::unordered_map<std::string, int>::const_iterator it =
+      uniformHandles.find(name);
+  if (it != uniformHandles.end())
+    return it->second;
+
+  int handle = (int)uniformNames.size();
+  uniformNames.push_back(name);
+  uniformHandles[name] = handle;
+  return handle;
+}
+
+Shader::UniformSlot &Shader::slot(int handle) const
+{
+  ensureReady();
+  std::vector<UniformSlot> &slots = program->uniformSlots;
+  if ((size_t)handle >= slots.size()) {
+    UniformSlot unresolved;
+    unresolved.resolved = false;
+    unresolved.location = -1;
+    unresolved.shadowSize = 0;
+    unresolved.shadowTag = 0;
+    slots.resize(handle + 1, unresolved);
+  }
+
+  UniformSlot &slot = slots[handle];
+  if (!slot.resolved) {
+    slot.location = program->findUniformLocation(uniformNames[handle]);
+    slot.resolved = true;
+  }
+  return slot;
 }
 
 void Shader::use()
 {
-  glUseProgram(ID);
+  // drawn before compilePending() got to it: build it now
+  ensureReady();
+  GLState::useProgram(program->ID);
 }
 
 unsigned int Shader::getID() const
 {
-  return ID;
+  ensureReady();
+  return program->ID;
 }
 
 void Shader::setBool(const std::string &name, bool value) const
 {
-  glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+  setBool(getUniformHandle(name), value);
 }
 void Shader::setInt(const std::string &name, int value) const
 {
-  glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+  setInt(getUniformHandle(name), value);
 }
 void Shader::setFloat(const std::string &name, float value) const
 {
-  glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+  setFloat(getUniformHandle(name), value);
+}
+void Shader::setVec4(const std::string &name, float x, float y, float z,
+                     float w) const
+{
+  setVec4(getUniformHandle(name), x, y, z, w);
 }
 
 void Shader::setMatrix(const std::string &name, int n, bool isTransposed, float* value) const
 {
-  unsigned int location = glGetUniformLocation(ID, name.c_str());
-  glUniformMatrix4fv(location, n, isTransposed, value);
+  setMatrix(getUniformHandle(name), n, isTransposed, value);
+}
+
+void Shader::setBool(int handle, bool value) const
+{
+  setInt(handle, (int)value);
+}
+void Shader::setInt(int handle, int value) const
+{
+  UniformSlot &uniform = slot(handle);
+  if (shadowUniform(uniform, &value, sizeof(value), 0))
+    glUniform1i(uniform.location, value);
+}
+void Shader::setFloat(int handle, float value) const
+{
+  UniformSlot &uniform = slot(handle);
+  if (shadowUniform(uniform, &value, sizeof(value), 0))
+    glUniform1f(uniform.location, value);
+}
+void Shader::setVec4(int handle, float x, float y, float z, float w) const
+{
+  UniformSlot &uniform = slot(handle);
+  float value[4] = {x, y, z, w};
+  if (shadowUniform(uniform, value, sizeof(value), 3))
+    glUniform4f(uniform.location, x, y, z, w);
+}
+
+void Shader::setMatrix(int handle, int n, bool isTransposed, float* value) const
+{
+  UniformSlot &uniform = slot(handle);
+  if (shadowUniform(uniform, value, n * 16 * sizeof(float), isTransposed ? 1 : 2))
+    glUniformMatrix4fv(uniform.location, n, isTransposed, value);
+}
+
+bool Shader::shadowUniform(UniformSlot &slot, const void* value, size_t size,
+                           int tag) const
+{
+  // an inactive uniform has nothing to upload, and isn't a saved call
+  if (slot.location < 0)
+    return false;
+  // uniforms keep their value in the program, so uploading what was set
+  // last time is a wasted driver call
+  if (slot.shadowSize == size && slot.shadowTag == tag &&
+      memcmp(slot.shadow, value, size) == 0) {
+    uniformStats.skipped++;
+    return false;
+  }
+
+  // values bigger than the shadow (matrix arrays) are always uploaded
+  if (size <= sizeof(slot.shadow)) {
+    memcpy(slot.shadow, value, size);
+    slot.shadowSize = size;
+    slot.shadowTag = tag;
+  } else {
+    slot.shadowSize = 0;
+  }
+  uniformStats.issued++;
+  return true;
+}
+
+Shader::UniformStats Shader::getUniformStats()
+{
+  return uniformStats;
+}
+
+void Shader::resetUniformStats()
+{
+  uniformStats = UniformStats();
 }
 
 //void Shader::setMat4(const std::string &name, const glm::mat4 &mat) const {
@@ -4,29 +4,195 @@
 // include glad to get all the required OpenGL headers
 #include <glad/glad.h>
 #include "glm/glm.hpp"
+#include "shader_source.h"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+class ShaderWatcher;
+
+// everything needed to build one program
+struct ShaderDesc
+{
+  std::string vertexPath;
+  std::string fragmentPath;
+  // "NAME" or "NAME VALUE", injected into both stages after #version
+  std::vector<std::string> defines;
+};
+
+// A handle to a linked program. Programs are shared process wide: every
+// Shader whose preprocessed sources hash the same refers to one GL program,
+// so building a duplicate costs a hash lookup. Copies are cheap and share the
+// program too; it is deleted with its last handle.
 class Shader
 {
 public:
-  // the program ID
-  unsigned int ID;
-
-  // constructor reads and builds the shader
-  Shader(const GLchar* vertexPath, const GLchar* fragmentPath);
+  // constructor reads and builds the shader. #include "file" is resolved
+  // relative to the including file, see ShaderPreprocessor.
+  Shader(const GLchar* vertexPath, const GLchar* fragmentPath,
+         const std::vector<std::string> &defines = std::vector<std::string>());
+  // same, from sources compiled into the binary. With
+  // ShaderPreprocessor::setPreferFiles(true) the files of the same name are
+  // read instead, for development.
+  Shader(const EmbeddedShader &vertex, const EmbeddedShader &fragment,
+         const std::vector<std::string> &defines = std::vector<std::string>());
   // use/activate the shader
   void use();
+  // turn on GL_KHR_parallel_shader_compile if the driver has it, so
+  // compileBatch() can keep several compiler threads busy. The loader is
+  // needed for the extension's entry point, e.g. glfwGetProcAddress.
+  static bool enableParallelCompile(GLADloadproc load);
+  // build many programs at once: every compile and link is issued up front
+  // and the results are collected as the driver finishes them. A program
+  // that failed to build has getID() 0.
+  static std::vector<std::unique_ptr<Shader> >
+  compileBatch(const std::vector<ShaderDesc> &descs);
+  // defer building: programs created from now on are only registered, and
+  // compilePending() builds them over the next frames. A program that is
+  // used before it is ready gets built on the spot.
+  static void setLazyCompile(bool lazy);
+  // call once per frame: issue and collect queued programs until budgetMs
+  // milliseconds have passed. Returns how many are still queued.
+  static size_t compilePending(double budgetMs);
+  // true once the program is built, or failed to build
+  bool isReady() const;
+  // every program built from now on that declares a uniform block with this
+  // name gets it bound to binding, see StreamBuffer::bindRange()
+  static void setBlockBinding(const std::string &blockName,
+                              unsigned int binding);
+  // bind the registered blocks a program declares, done on every link
+  static void bindUniformBlocks(unsigned int program);
+  // bind one uniform block of this program by hand
+  void bindUniformBlock(const std::string &blockName, unsigned int binding);
+  // make an embedded source known to the preprocessor, returns its name
+  static const char* addEmbedded(const EmbeddedShader &shader);
+  // start watching the source files for changes on a background thread.
+  // Embedded sources are not watched.
+  void watch();
+  // call between frames: if the watched sources changed and the new program
+  // compiles and links, swap it in and return true. On failure the old
+  // program stays in place. Uniform values have to be set again after a swap.
+  bool reload();
+  // resolve a uniform name to a handle once, then set it by handle in the
+  // render loop. A handle is valid for every Shader and stays valid if the
+  // program is relinked.
+  static int getUniformHandle(const std::string &name);
   // utility uniform functions
   void setBool(const std::string &name, bool value) const;
   void setInt(const std::string &name, int value) const;
   void setFloat(const std::string &name, float value) const;
+  void setVec4(const std::string &name, float x, float y, float z,
+               float w) const;
+  // the program ID, 0 if the program failed to build
   unsigned int getID() const;
   void setMatrix(const std::string &name, int n, bool isTransposed,
                  float* value) const;
+  // same as above, but by handle: no string lookup at all
+  void setBool(int handle, bool value) const;
+  void setInt(int handle, int value) const;
+  void setFloat(int handle, float value) const;
+  void setVec4(int handle, float x, float y, float z, float w) const;
+  void setMatrix(int handle, int n, bool isTransposed, float* value) const;
+
+  // an active attribute or uniform as reported by the driver
+  struct Variable
+  {
+    std::string name;
+    GLenum type;
+    int size;
+    int location;
+  };
+  // reflection of the linked program, refreshed on every relink
+  const std::vector<Variable> &getAttributes() const;
+  const std::vector<Variable> &getUniforms() const;
+
+  // how many uniform uploads reached the driver and how many were skipped
+  // because the value didn't change, across all shaders
+  struct UniformStats
+  {
+    unsigned long issued;
+    unsigned long skipped;
+    UniformStats() : issued(0), skipped(0) {}
+  };
+  static UniformStats getUniformStats();
+  static void resetUniformStats();
 //  void setMat4(const std::string &name, const glm::mat4 &mat) const;
+
+private:
+  static bool parallelCompile;
+  static bool lazyCompile;
+  // uniform block name -> binding point
+  static std::unordered_map<std::string, unsigned int> blockBindings;
+  static UniformStats uniformStats;
+
+  // a resolved uniform, indexed by handle
+  struct UniformSlot
+  {
+    // location is looked up on first use after each link
+    bool resolved;
+    int location;
+    // last value uploaded, shadowSize 0 if unknown
+    unsigned char shadow[64];
+    size_t shadowSize;
+    // tells apart values of the same size, e.g. a transposed matrix
+    int shadowTag;
+  };
+
+  // the state shared by every handle to one GL program
+  struct Program;
+  std::shared_ptr<Program> program;
+
+  // preprocessed-source hash -> live program
+  static std::unordered_map<std::string, std::weak_ptr<Program> > programs;
+  // programs waiting for compilePending(), in creation order
+  static std::vector<std::weak_ptr<Program> > compileQueue;
+  // uniform name <-> handle, shared by all programs
+  static std::unordered_map<std::string, int> uniformHandles;
+  static std::vector<std::string> uniformNames;
+
+  // the registered program for key, or a new one wrapping id
+  static std::shared_ptr<Program>
+  findProgram(const std::string &key);
+  static std::shared_ptr<Program>
+  addProgram(const std::string &key, const ShaderDesc &desc,
+             const std::vector<std::string> &dependencies, unsigned int id);
+  // register a program without building it, see setLazyCompile()
+  static std::shared_ptr<Program>
+  queueProgram(const std::string &key, const ShaderDesc &desc,
+               const std::vector<std::string> &dependencies,
+               const ShaderSource &vertexCode,
+               const ShaderSource &fragmentCode);
+
+  static bool loadSources(const ShaderDesc &desc, ShaderSource &vertexCode,
+                          ShaderSource &fragmentCode,
+                          std::vector<std::string>* dependencies);
+  // compile and link a program, going through the binary cache. Returns 0
+  // if compiling or linking failed.
+  static unsigned int buildProgram(const ShaderSource &vertexCode,
+                                   const ShaderSource &fragmentCode,
+                                   const std::string &cacheKey);
+  static unsigned int compileProgram(const ShaderSource &vShaderCode,
+                                     const ShaderSource &fShaderCode);
+  // the steps of compileProgram(), split so that a batch can issue all the
+  // compiles and links before it waits on any of them
+  static unsigned int compileStage(GLenum type, const ShaderSource &code);
+  static unsigned int linkStages(unsigned int vertex, unsigned int fragment);
+  static unsigned int finishProgram(unsigned int program, unsigned int vertex,
+                                    unsigned int fragment);
+  // a handle to a program from the registry
+  explicit Shader(const std::shared_ptr<Program> &program);
+  // build a queued program now, blocking until it is linked
+  void ensureReady() const;
+  // the slot of a handle in this program, resolved if needed
+  UniformSlot &slot(int handle) const;
+  // compare against and update the shadow of a uniform, returns true if the
+  // value has to be uploaded
+  bool shadowUniform(UniformSlot &slot, const void* value, size_t size,
+                     int tag) const;
 };
 #endif
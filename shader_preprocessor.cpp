@@ -0,0 +1,264 @@
+#include "shader_preprocessor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+std::string directoryOf(const std::string &path)
+{
+  std::string::size_type slash = path.rfind('/');
+  return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+const char* skipBlanks(const char* p, const char* end)
+{
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+  return p;
+}
+
+// matches  #include "name"  with optional whitespace, returns the name
+bool parseInclude(const char* line, const char* end, std::string &name)
+{
+  const char* p = skipBlanks(line, end);
+  if (p == end || *p != '#')
+    return false;
+  p = skipBlanks(p + 1, end);
+  if (end - p < 7 || memcmp(p, "include", 7) != 0)
+    return false;
+  const char* open = (const char*)memchr(p + 7, '"', end - p - 7);
+  if (!open)
+    return false;
+  const char* close = (const char*)memchr(open + 1, '"', end - open - 1);
+  if (!close)
+    return false;
+  name.assign(open + 1, close);
+  return true;
+}
+}
+
+std::mutex ShaderPreprocessor::mutex;
+std::unordered_map<std::string, ShaderPreprocessor::FileEntry>
+    ShaderPreprocessor::files;
+std::unordered_map<std::string, ShaderPreprocessor::ProgramEntry>
+    ShaderPreprocessor::programs;
+std::unordered_map<std::string, EmbeddedShader> ShaderPreprocessor::embedded;
+bool ShaderPreprocessor::preferFiles = false;
+
+bool ShaderPreprocessor::stat(const std::string &path, FileStamp &stamp)
+{
+  // embedded sources never change, and switching to files gives a different
+  // stamp, so memoized entries are redone in either direction
+  const EmbeddedShader* shader = findEmbedded(path);
+  if (shader) {
+    stamp.mtimeSec = -1;
+    stamp.mtimeNsec = 0;
+    stamp.size = (long long)shader->size;
+    return true;
+  }
+  return FileStamp::read(path, stamp);
+}
+
+bool ShaderPreprocessor::isCurrent(
+    const std::vector<std::pair<std::string, FileStamp> > &dependencies)
+{
+  // a stat per file is much cheaper than reading and expanding it again
+  for (const std::pair<std::string, FileStamp> &dependency : dependencies) {
+    FileStamp stamp;
+    if (!stat(dependency.first, stamp) || stamp != dependency.second)
+      return false;
+  }
+  return true;
+}
+
+const ShaderPreprocessor::FileEntry*
+ShaderPreprocessor::expandFile(const std::string &path,
+                               std::vector<std::string> &stack)
+{
+  std::unordered_map<std::string, FileEntry>::iterator it = files.find(path);
+  if (it != files.end() && isCurrent(it->second.dependencies))
+    return &it->second;
+
+  if (std::find(stack.begin(), stack.end(), path) != stack.end()) {
+    std::cout << "ERROR::SHADER::INCLUDE_CYCLE " << path << std::endl;
+    return NULL;
+  }
+
+  FileEntry entry;
+  FileStamp stamp;
+  std::shared_ptr<const SourceFile> file;
+  const char* begin;
+  const char* end;
+  const EmbeddedShader* shader = findEmbedded(path);
+  if (shader) {
+    // static data, nothing to keep alive
+    stat(path, stamp);
+    begin = shader->source;
+    end = begin + shader->size;
+  } else {
+    // mapped, unless it changed since it was last expanded: then it is
+    // being edited, and an editor may truncate it under a mapping any time
+    std::shared_ptr<SourceFile> text = std::make_shared<SourceFile>();
+    if (!text->open(path, it != files.end(), stamp)) {
+      std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ " << path
+                << std::endl;
+      return NULL;
+    }
+    begin = text->data();
+    end = begin + text->size();
+    file = text;
+  }
+  entry.dependencies.push_back(std::make_pair(path, stamp));
+
+  // runs of lines without directives are referenced straight from the
+  // mapping, only #include lines are replaced
+  stack.push_back(path);
+  const char* run = begin;
+  std::string name;
+  int lineNumber = 0;
+  for (const char* line = begin; line < end;) {
+    const char* eol = (const char*)memchr(line, '\n', end - line);
+    const char* next = eol ? eol + 1 : end;
+    lineNumber++;
+    if (!parseInclude(line, eol ? eol : end, name)) {
+      line = next;
+      continue;
+    }
+
+    // includes resolve relative to the including file
+    const FileEntry* included = expandFile(directoryOf(path) + name, stack);
+    if (!included) {
+      std::cout << "ERROR::SHADER::INCLUDE_FAILED " << path << ":" << lineNumber
+                << std::endl;
+      stack.pop_back();
+      return NULL;
+    }
+    entry.code.append(file, run, line - run);
+    entry.code.append(included->code);
+    // keep compiler errors in this file on the right line
+    entry.code.append("\n#line " + std::to_string(lineNumber + 1) + "\n");
+    for (const std::pair<std::string, FileStamp> &dependency :
+         included->dependencies)
+      entry.dependencies.push_back(dependency);
+    line = run = next;
+  }
+  entry.code.append(file, run, end - run);
+  stack.pop_back();
+
+  FileEntry &stored = files[path];
+  stored = entry;
+  return &stored;
+}
+
+ShaderSource
+ShaderPreprocessor::injectDefines(const ShaderSource &code,
+                                  const std::vector<std::string> &defines)
+{
+  if (defines.empty())
+    return code;
+
+  std::string block;
+  for (const std::string &define : defines)
+    block += "#define " + define + "\n";
+
+  // #version has to stay the first directive, so the block goes in right
+  // after that line, splitting the piece that holds it
+  static const char VERSION[] = "#version";
+  int lines = 0;
+  for (GLsizei i = 0; i < code.count(); i++) {
+    const char* begin = code.strings()[i];
+    const char* end = begin + code.lengths()[i];
+    const char* version = std::search(begin, end, VERSION, VERSION + 8);
+    if (version == end) {
+      lines += (int)std::count(begin, end, '\n');
+      continue;
+    }
+
+    const char* eol = std::find(version, end, '\n');
+    lines += (int)std::count(begin, eol, '\n') + 1;
+    std::string text = std::string(eol == end ? "\n" : "") + block + "#line " +
+                       std::to_string(lines + 1) + "\n";
+    ShaderSource result = code;
+    result.insert(i, (eol == end ? eol : eol + 1) - begin, text);
+    return result;
+  }
+
+  ShaderSource result(block + "#line 1\n");
+  result.append(code);
+  return result;
+}
+
+bool ShaderPreprocessor::expand(const std::string &path,
+                                const std::vector<std::string> &defines,
+                                ShaderSource &code,
+                                std::vector<std::string>* dependencies)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  std::string key = path;
+  for (const std::string &define : defines)
+    key += '\0' + define;
+
+  std::unordered_map<std::string, ProgramEntry>::iterator it =
+      programs.find(key);
+  if (it == programs.end() || !isCurrent(it->second.dependencies)) {
+    std::vector<std::string> stack;
+    const FileEntry* file = expandFile(path, stack);
+    if (!file) {
+      programs.erase(key);
+      return false;
+    }
+    ProgramEntry &entry = programs[key];
+    entry.code = injectDefines(file->code, defines);
+    entry.dependencies = file->dependencies;
+    it = programs.find(key);
+  }
+
+  code = it->second.code;
+  if (dependencies) {
+    dependencies->clear();
+    for (const std::pair<std::string, FileStamp> &dependency :
+         it->second.dependencies)
+      if (std::find(dependencies->begin(), dependencies->end(),
+                    dependency.first) == dependencies->end())
+        dependencies->push_back(dependency.first);
+  }
+  return true;
+}
+
+void ShaderPreprocessor::addEmbedded(const EmbeddedShader* shaders,
+                                     size_t count)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for (size_t i = 0; i < count; i++)
+    embedded[shaders[i].name] = shaders[i];
+}
+
+void ShaderPreprocessor::setPreferFiles(bool prefer)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  preferFiles = prefer;
+}
+
+bool ShaderPreprocessor::isEmbedded(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return findEmbedded(path) != NULL;
+}
+
+const EmbeddedShader* ShaderPreprocessor::findEmbedded(const std::string &path)
+{
+  if (preferFiles)
+    return NULL;
+  std::unordered_map<std::string, EmbeddedShader>::const_iterator it =
+      embedded.find(path);
+  return it != embedded.end() ? &it->second : NULL;
+}
+
+void ShaderPreprocessor::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  files.clear();
+  programs.clear();
+}
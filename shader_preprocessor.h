@@ -0,0 +1,71 @@
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+
+#include "shader_source.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Expands #include "file" directives and injects per-program #defines into
+// GLSL sources. Files are memory mapped and the result references the
+// mappings, so text outside the directives is never copied. A file that
+// changed since it was first expanded is being edited and is copied
+// instead, see SourceFile. Expanded files are memoized by path and
+// modification time, so an include shared by many programs is read and
+// expanded only once, and whole programs are memoized by (path, defines) on
+// top of that. Safe to call from several threads.
+class ShaderPreprocessor
+{
+public:
+  // expand the file at path. Each define is "NAME" or "NAME VALUE" and is
+  // inserted right after the #version line. dependencies, if given,
+  // receives every file the result was built from, path itself first.
+  static bool expand(const std::string &path,
+                     const std::vector<std::string> &defines,
+                     ShaderSource &code,
+                     std::vector<std::string>* dependencies = NULL);
+  // make sources compiled into the binary (see embed_shaders.cmake)
+  // available under their file names. They take precedence over files on
+  // disk, includes included, unless setPreferFiles(true) is called.
+  static void addEmbedded(const EmbeddedShader* shaders, size_t count);
+  // dev override: read from disk even where an embedded source exists
+  static void setPreferFiles(bool prefer);
+  // true if path is currently served from an embedded source
+  static bool isEmbedded(const std::string &path);
+  // drop everything memoized so far
+  static void clear();
+
+private:
+  // a file with its includes resolved
+  struct FileEntry
+  {
+    ShaderSource code;
+    // every file the code was built from and its stamp at the time
+    std::vector<std::pair<std::string, FileStamp> > dependencies;
+  };
+
+  // a file with its includes resolved and the defines injected
+  struct ProgramEntry
+  {
+    ShaderSource code;
+    std::vector<std::pair<std::string, FileStamp> > dependencies;
+  };
+
+  static std::mutex mutex;
+  static std::unordered_map<std::string, FileEntry> files;
+  static std::unordered_map<std::string, ProgramEntry> programs;
+  static std::unordered_map<std::string, EmbeddedShader> embedded;
+  static bool preferFiles;
+
+  static const EmbeddedShader* findEmbedded(const std::string &path);
+  static bool stat(const std::string &path, FileStamp &stamp);
+  static bool isCurrent(
+      const std::vector<std::pair<std::string, FileStamp> > &dependencies);
+  static const FileEntry* expandFile(const std::string &path,
+                                     std::vector<std::string> &stack);
+  static ShaderSource injectDefines(const ShaderSource &code,
+                                    const std::vector<std::string> &defines);
+};
+#endif
@@ -0,0 +1,161 @@
+#include "shader_source.h"
+
+#include <fstream>
+#include <iterator>
+
+#include <sys/stat.h>
+
+bool FileStamp::read(const std::string &path, FileStamp &stamp)
+{
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0)
+    return false;
+  stamp.mtimeSec = st.st_mtime;
+#ifdef __linux__
+  stamp.mtimeNsec = st.st_mtim.tv_nsec;
+#else
+  stamp.mtimeNsec = 0;
+#endif
+  stamp.size = st.st_size;
+  return true;
+}
+
+SourceFile::SourceFile() : copied(false) {}
+
+bool SourceFile::open(const std::string &path, bool copy, FileStamp &stamp)
+{
+  // stat first: if the file changes in between, the stamp is the older one
+  // and isCurrent() says so
+  this->path = path;
+  if (!FileStamp::read(path, this->stamp))
+    return false;
+  stamp = this->stamp;
+  copied = copy;
+  if (!copy)
+    return mapping.open(path);
+
+  std::ifstream in(path.c_str(), std::ios::binary);
+  if (!in)
+    return false;
+  text.assign(std::istreambuf_iterator<char>(in),
+              std::istreambuf_iterator<char>());
+  return !in.bad();
+}
+
+bool SourceFile::isCurrent() const
+{
+  if (copied)
+    return true;
+  FileStamp now;
+  return FileStamp::read(path, now) && now == stamp;
+}
+
+const char* SourceFile::data() const
+{
+  return copied ? text.data() : mapping.data();
+}
+
+size_t SourceFile::size() const
+{
+  return copied ? text.size() : mapping.size();
+}
+
+ShaderSource::ShaderSource() {}
+
+ShaderSource::ShaderSource(const std::string &code)
+{
+  append(code);
+}
+
+void ShaderSource::append(const std::shared_ptr<const SourceFile> &file,
+                          const char* data, size_t length)
+{
+  if (length == 0)
+    return;
+  appendPiece(data, length);
+  if (file && (files.empty() || files.back() != file))
+    files.push_back(file);
+}
+
+void ShaderSource::append(const std::string &text)
+{
+  if (text.empty())
+    return;
+  std::shared_ptr<std::string> copy = std::make_shared<std::string>(text);
+  storage.push_back(copy);
+  appendPiece(copy->data(), copy->size());
+}
+
+void ShaderSource::append(const ShaderSource &other)
+{
+  pieces.insert(pieces.end(), other.pieces.begin(), other.pieces.end());
+  pieceLengths.insert(pieceLengths.end(), other.pieceLengths.begin(),
+                      other.pieceLengths.end());
+  storage.insert(storage.end(), other.storage.begin(), other.storage.end());
+  files.insert(files.end(), other.files.begin(), other.files.end());
+}
+
+void ShaderSource::insert(GLsizei piece, size_t offset,
+                          const std::string &text)
+{
+  std::shared_ptr<std::string> copy = std::make_shared<std::string>(text);
+  storage.push_back(copy);
+
+  // split the piece in two around the new one, both halves keep pointing
+  // into the same storage
+  const GLchar* data = pieces[piece];
+  GLint length = pieceLengths[piece];
+  pieceLengths[piece] = (GLint)offset;
+  pieces.insert(pieces.begin() + piece + 1, copy->data());
+  pieceLengths.insert(pieceLengths.begin() + piece + 1, (GLint)copy->size());
+  pieces.insert(pieces.begin() + piece + 2, data + offset);
+  pieceLengths.insert(pieceLengths.begin() + piece + 2,
+                      length - (GLint)offset);
+}
+
+GLsizei ShaderSource::count() const
+{
+  return (GLsizei)pieces.size();
+}
+
+const GLchar* const* ShaderSource::strings() const
+{
+  return pieces.data();
+}
+
+const GLint* ShaderSource::lengths() const
+{
+  return pieceLengths.data();
+}
+
+size_t ShaderSource::size() const
+{
+  size_t total = 0;
+  for (GLint length : pieceLengths)
+    total += length;
+  return total;
+}
+
+std::string ShaderSource::str() const
+{
+  std::string code;
+  code.reserve(size());
+  for (size_t i = 0; i < pieces.size(); i++)
+    code.append(pieces[i], pieceLengths[i]);
+  return code;
+}
+
+bool ShaderSource::isCurrent() const
+{
+  // a stat per file, much cheaper than the compile that follows
+  for (const std::shared_ptr<const SourceFile> &file : files)
+    if (!file->isCurrent())
+      return false;
+  return true;
+}
+
+void ShaderSource::appendPiece(const char* data, size_t length)
+{
+  pieces.push_back(data);
+  pieceLengths.push_back((GLint)length);
+}
@@ -0,0 +1,108 @@
+#ifndef SHADER_SOURCE_H
+#define SHADER_SOURCE_H
+
+#include <glad/glad.h>
+#include "mapped_file.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// a GLSL file compiled into the binary, see embed_shaders.cmake
+struct EmbeddedShader
+{
+  // the file name it was generated from
+  const char* name;
+  const char* source;
+  size_t size;
+};
+
+// identifies one version of a file on disk
+struct FileStamp
+{
+  long long mtimeSec;
+  long long mtimeNsec;
+  long long size;
+
+  // stat the file at path, false if there is none
+  static bool read(const std::string &path, FileStamp &stamp);
+  bool operator==(const FileStamp &o) const
+  {
+    return mtimeSec == o.mtimeSec && mtimeNsec == o.mtimeNsec &&
+           size == o.size;
+  }
+  bool operator!=(const FileStamp &o) const { return !(*this == o); }
+};
+
+// The text of one shader file, memory mapped so that it reaches the driver
+// without a copy. The mapping follows edits made in place, and reading past
+// the end of a file truncated under it crashes, so the text may only be used
+// while isCurrent(). A file that is being edited can be copied instead.
+class SourceFile
+{
+public:
+  SourceFile();
+  SourceFile(const SourceFile &) = delete;
+  SourceFile &operator=(const SourceFile &) = delete;
+
+  // map the file at path, or read it into a copy if copy is set. stamp
+  // receives the file's stat from before. False if it can't be read.
+  bool open(const std::string &path, bool copy, FileStamp &stamp);
+  // true if the text is still what the file held when opened: always for
+  // a copy, for a mapping while the size and modification time are the same
+  bool isCurrent() const;
+  const char* data() const;
+  size_t size() const;
+
+private:
+  std::string path;
+  FileStamp stamp;
+  MappedFile mapping;
+  std::string text;
+  bool copied;
+};
+
+// GLSL source as a list of pieces, in the form glShaderSource takes them.
+// Pieces point into mapped files or small owned strings, so a file's text
+// reaches the driver without being copied. Copying a ShaderSource only
+// copies the piece pointers, the storage behind them is shared.
+class ShaderSource
+{
+public:
+  ShaderSource();
+  // a single owned piece
+  explicit ShaderSource(const std::string &code);
+
+  // reference bytes of file, which is kept alive and shared, not copied. A
+  // NULL file stands for static data.
+  void append(const std::shared_ptr<const SourceFile> &file,
+              const char* data, size_t length);
+  // append an owned copy of text
+  void append(const std::string &text);
+  void append(const ShaderSource &other);
+  // insert an owned copy of text at offset bytes into the given piece
+  void insert(GLsizei piece, size_t offset, const std::string &text);
+
+  // the arguments for glShaderSource
+  GLsizei count() const;
+  const GLchar* const* strings() const;
+  const GLint* lengths() const;
+
+  size_t size() const;
+  // the whole source in one string, for when a copy is fine
+  std::string str() const;
+  // false if a file the pieces point into changed since it was mapped, see
+  // SourceFile::isCurrent(). The pieces must not be read then; expand the
+  // source again instead.
+  bool isCurrent() const;
+
+private:
+  std::vector<const GLchar*> pieces;
+  std::vector<GLint> pieceLengths;
+  // the owned pieces
+  std::vector<std::shared_ptr<const std::string> > storage;
+  std::vector<std::shared_ptr<const SourceFile> > files;
+
+  void appendPiece(const char* data, size_t length);
+};
+#endif
@@ -0,0 +1,103 @@
+#include "shader_variants.h"
+
+ShaderVariants::ShaderVariants(const GLchar* vertexPath,
+                               const GLchar* fragmentPath,
+                               const std::vector<std::string> &features)
+    : features(features), watching(false)
+{
+  base.vertexPath = vertexPath;
+  base.fragmentPath = fragmentPath;
+  if (this->features.size() > MAX_FEATURES) {
+    std::cout << "ERROR::SHADER_VARIANTS::TOO_MANY_FEATURES" << std::endl;
+    this->features.resize(MAX_FEATURES);
+  }
+  variants.resize(1u << this->features.size());
+}
+
+ShaderVariants::ShaderVariants(const EmbeddedShader &vertex,
+                               const EmbeddedShader &fragment,
+                               const std::vector<std::string> &features)
+    : ShaderVariants(Shader::addEmbedded(vertex), Shader::addEmbedded(fragment),
+                     features)
+{
+}
+
+unsigned int ShaderVariants::featureBit(const std::string &name) const
+{
+  for (size_t i = 0; i < features.size(); i++)
+    if (features[i] == name)
+      return 1u << i;
+  return 0;
+}
+
+unsigned int ShaderVariants::variantCount() const
+{
+  return (unsigned int)variants.size();
+}
+
+ShaderDesc ShaderVariants::descFor(unsigned int mask) const
+{
+  ShaderDesc desc = base;
+  for (size_t i = 0; i < features.size(); i++)
+    if (mask & (1u << i))
+      desc.defines.push_back(features[i]);
+  return desc;
+}
+
+void ShaderVariants::adopt(unsigned int mask, std::unique_ptr<Shader> shader)
+{
+  if (watching)
+    shader->watch();
+  variants[mask] = std::move(shader);
+}
+
+void ShaderVariants::compileAll()
+{
+  std::vector<ShaderDesc> descs;
+  std::vector<unsigned int> masks;
+  for (unsigned int mask = 0; mask < variants.size(); mask++) {
+    if (variants[mask])
+      continue;
+    descs.push_back(descFor(mask));
+    masks.push_back(mask);
+  }
+
+  std::vector<std::unique_ptr<Shader> > built = Shader::compileBatch(descs);
+  for (size_t i = 0; i < built.size(); i++)
+    adopt(masks[i], std::move(built[i]));
+}
+
+Shader &ShaderVariants::get(unsigned int mask)
+{
+  mask &= (unsigned int)variants.size() - 1;
+  if (!variants[mask]) {
+    ShaderDesc desc = descFor(mask);
+    adopt(mask, std::unique_ptr<Shader>(new Shader(
+                    desc.vertexPath.c_str(), desc.fragmentPath.c_str(),
+                    desc.defines)));
+  }
+  return *variants[mask];
+}
+
+int ShaderVariants::getUniformHandle(const std::string &name) const
+{
+  // handles are process wide, so one is valid for every variant
+  return Shader::getUniformHandle(name);
+}
+
+void ShaderVariants::watch()
+{
+  watching = true;
+  for (std::unique_ptr<Shader> &variant : variants)
+    if (variant)
+      variant->watch();
+}
+
+bool ShaderVariants::reload()
+{
+  bool reloaded = false;
+  for (std::unique_ptr<Shader> &variant : variants)
+    if (variant && variant->reload())
+      reloaded = true;
+  return reloaded;
+}
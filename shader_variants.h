@@ -0,0 +1,54 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "shader.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Compile-time permutations of one vertex/fragment pair. Each feature is a
+// bit in a mask; the variant for a mask is compiled with the names of its set
+// bits #defined, so the shaders can drop unused work with #ifdef instead of
+// branching at runtime. Variants are looked up by mask in O(1).
+class ShaderVariants
+{
+public:
+  // at most MAX_FEATURES features, feature i is bit (1 << i)
+  static const unsigned int MAX_FEATURES = 8;
+
+  ShaderVariants(const GLchar* vertexPath, const GLchar* fragmentPath,
+                 const std::vector<std::string> &features);
+  // same, from sources compiled into the binary
+  ShaderVariants(const EmbeddedShader &vertex, const EmbeddedShader &fragment,
+                 const std::vector<std::string> &features);
+
+  // the bit of a named feature, 0 if there is no such feature
+  unsigned int featureBit(const std::string &name) const;
+  // number of possible masks, every mask below this is valid
+  unsigned int variantCount() const;
+
+  // build every variant at once instead of on first use
+  void compileAll();
+  // the variant for a mask, compiled on the spot if needed
+  Shader &get(unsigned int mask);
+
+  // resolve a uniform once for all variants, same as
+  // Shader::getUniformHandle()
+  int getUniformHandle(const std::string &name) const;
+
+  // hot reload every variant built so far, see Shader::watch()
+  void watch();
+  // true if any variant was replaced
+  bool reload();
+
+private:
+  ShaderDesc base;
+  std::vector<std::string> features;
+  std::vector<std::unique_ptr<Shader> > variants;
+  bool watching;
+
+  ShaderDesc descFor(unsigned int mask) const;
+  void adopt(unsigned int mask, std::unique_ptr<Shader> shader);
+};
+#endif
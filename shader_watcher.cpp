@@ -0,0 +1,152 @@
+#include "shader_watcher.h"
+
+#include <iostream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+void splitPath(const std::string &path, std::string &dir, std::string &file)
+{
+  std::string::size_type slash = path.rfind('/');
+  if (slash == std::string::npos) {
+    dir = ".";
+    file = path;
+  } else {
+    dir = path.substr(0, slash + 1);
+    file = path.substr(slash + 1);
+  }
+}
+}
+
+ShaderWatcher::ShaderWatcher(const std::vector<std::string> &paths,
+                             Loader loader)
+    : loader(loader), inotifyFd(-1), stopFd(-1), hasPending(false)
+{
+#ifdef __linux__
+  inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (inotifyFd < 0 || stopFd < 0) {
+    std::cout << "ERROR::SHADER_WATCHER::INOTIFY_INIT_FAILED" << std::endl;
+    return;
+  }
+
+  // watch the directories rather than the files: editors usually save by
+  // writing a new file and renaming it over the old one, which would
+  // silently drop a watch on the file itself
+  for (const std::string &path : paths) {
+    std::string dir, file;
+    splitPath(path, dir, file);
+    int wd = inotify_add_watch(inotifyFd, dir.c_str(),
+                               IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (wd < 0) {
+      std::cout << "ERROR::SHADER_WATCHER::CANNOT_WATCH " << dir << std::endl;
+      continue;
+    }
+    // inotify hands out one descriptor per directory
+    bool found = false;
+    for (WatchedDir &watched : dirs) {
+      if (watched.wd == wd) {
+        watched.files.push_back(file);
+        found = true;
+      }
+    }
+    if (!found)
+      dirs.push_back(WatchedDir{wd, std::vector<std::string>(1, file)});
+  }
+
+  thread = std::thread(&ShaderWatcher::run, this);
+#else
+  (void)paths;
+  std::cout << "ERROR::SHADER_WATCHER::NOT_SUPPORTED" << std::endl;
+#endif
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+#ifdef __linux__
+  if (thread.joinable()) {
+    uint64_t one = 1;
+    if (write(stopFd, &one, sizeof(one)) != sizeof(one))
+      std::cout << "ERROR::SHADER_WATCHER::CANNOT_STOP" << std::endl;
+    thread.join();
+  }
+  if (inotifyFd >= 0)
+    close(inotifyFd);
+  if (stopFd >= 0)
+    close(stopFd);
+#endif
+}
+
+bool ShaderWatcher::isActive() const
+{
+  return thread.joinable();
+}
+
+bool ShaderWatcher::takeSources(std::vector<std::string> &sources)
+{
+  // cheap check first, this is called every frame
+  if (!hasPending.load(std::memory_order_acquire))
+    return false;
+
+  std::lock_guard<std::mutex> lock(pendingMutex);
+  sources.swap(pendingSources);
+  pendingSources.clear();
+  hasPending.store(false, std::memory_order_release);
+  return true;
+}
+
+bool ShaderWatcher::isWatched(int wd, const char* name) const
+{
+  for (const WatchedDir &watched : dirs) {
+    if (watched.wd != wd)
+      continue;
+    for (const std::string &file : watched.files)
+      if (file == name)
+        return true;
+  }
+  return false;
+}
+
+void ShaderWatcher::run()
+{
+#ifdef __linux__
+  alignas(struct inotify_event) char buffer[4096];
+  pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {stopFd, POLLIN, 0}};
+
+  while (true) {
+    if (poll(fds, 2, -1) < 0)
+      continue;
+    if (fds[1].revents & POLLIN)
+      return;
+    if (!(fds[0].revents & POLLIN))
+      continue;
+
+    // drain every queued event, one save often produces several
+    bool changed = false;
+    ssize_t length;
+    while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+      for (char* p = buffer; p < buffer + length;) {
+        const struct inotify_event* event = (const struct inotify_event*)p;
+        if (event->len > 0 && isWatched(event->wd, event->name))
+          changed = true;
+        p += sizeof(struct inotify_event) + event->len;
+      }
+    }
+    if (!changed)
+      continue;
+
+    std::vector<std::string> sources;
+    if (!loader(sources))
+      continue;
+
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    pendingSources.swap(sources);
+    hasPending.store(true, std::memory_order_release);
+  }
+#endif
+}
@@ -0,0 +1,51 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Watches a set of files through inotify on a background thread. When one of
+// them changes the loader is run on that thread, so the render thread only
+// has to pick up the result between frames.
+class ShaderWatcher
+{
+public:
+  // fills one string per shader stage, returns false if a file can't be read
+  typedef std::function<bool(std::vector<std::string> &)> Loader;
+
+  ShaderWatcher(const std::vector<std::string> &paths, Loader loader);
+  ~ShaderWatcher();
+
+  ShaderWatcher(const ShaderWatcher &) = delete;
+  ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+
+  // false if inotify couldn't be set up, the watcher then never fires
+  bool isActive() const;
+  // hands out the sources loaded since the last call, if any
+  bool takeSources(std::vector<std::string> &sources);
+
+private:
+  struct WatchedDir
+  {
+    int wd;
+    std::vector<std::string> files;
+  };
+
+  Loader loader;
+  int inotifyFd;
+  int stopFd;
+  std::vector<WatchedDir> dirs;
+  std::thread thread;
+
+  std::mutex pendingMutex;
+  std::vector<std::string> pendingSources;
+  std::atomic<bool> hasPending;
+
+  void run();
+  bool isWatched(int wd, const char* name) const;
+};
+#endif
@@ -0,0 +1,148 @@
+#include "stream_buffer.h"
+#include "gl_state.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+// one second waits in retire() before it gives up on a fence
+const int RETIRE_WAIT_ATTEMPTS = 5;
+}
+
+StreamBuffer::StreamBuffer(GLenum target, size_t size)
+    : target(target), capacity(size), persistent(isPersistentSupported()),
+      memory(NULL), written(0), released(0), flushed(0)
+{
+  glGenBuffers(1, &ID);
+  GLState::bindBuffer(target, ID);
+  if (persistent) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(target, capacity, NULL, flags);
+    memory = (unsigned char*)glMapBufferRange(target, 0, capacity, flags);
+  }
+  if (!memory) {
+    persistent = false;
+    glBufferData(target, capacity, NULL, GL_STREAM_DRAW);
+    staging.resize(capacity);
+    memory = staging.data();
+  }
+}
+
+StreamBuffer::~StreamBuffer()
+{
+  for (const Region &region : inFlight)
+    glDeleteSync(region.sync);
+  if (persistent) {
+    GLState::bindBuffer(target, ID);
+    glUnmapBuffer(target);
+  }
+  GLState::deleteBuffer(ID);
+}
+
+bool StreamBuffer::isPersistentSupported()
+{
+  return GLAD_GL_VERSION_4_4 != 0;
+}
+
+void* StreamBuffer::allocate(size_t size, size_t alignment, size_t &offset)
+{
+  if (size > capacity) {
+    std::cout << "ERROR::STREAM_BUFFER::ALLOCATION_TOO_LARGE" << std::endl;
+    return NULL;
+  }
+
+  // align, or skip the tail of the ring if the allocation doesn't fit there
+  size_t start = (size_t)(written % capacity);
+  size_t padding = alignment > 1 ? (alignment - start % alignment) % alignment
+                                 : 0;
+  if (start + padding + size > capacity)
+    padding = capacity - start;
+  uint64_t needed = padding + size;
+
+  // wait for GL to finish with the oldest frames until there is room
+  retire(false);
+  while (written + needed - released > capacity && !inFlight.empty())
+    retire(true);
+  if (written + needed - released > capacity) {
+    // the current frame alone fills the ring
+    std::cout << "ERROR::STREAM_BUFFER::OUT_OF_SPACE" << std::endl;
+    return NULL;
+  }
+
+  offset = (start + padding) % capacity;
+  written += needed;
+  return memory + offset;
+}
+
+void StreamBuffer::flush()
+{
+  if (!persistent && flushed < written)
+    upload(flushed, written);
+  flushed = written;
+}
+
+void StreamBuffer::upload(uint64_t begin, uint64_t end)
+{
+  // at most two pieces, before and after the ring wraps
+  GLState::bindBuffer(target, ID);
+  while (begin < end) {
+    size_t offset = (size_t)(begin % capacity);
+    size_t size = (size_t)std::min<uint64_t>(end - begin, capacity - offset);
+    glBufferSubData(target, offset, size, memory + offset);
+    begin += size;
+  }
+}
+
+void StreamBuffer::bindRange(unsigned int index, size_t offset, size_t size)
+{
+  GLState::bindBufferRange(target, index, ID, offset, size);
+}
+
+void StreamBuffer::fence()
+{
+  if (persistent) {
+    Region region;
+    region.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region.end = written;
+    inFlight.push_back(region);
+    return;
+  }
+  // the driver keeps the old storage alive for the draws still reading it
+  // and hands out fresh memory, so nothing is in flight from here on
+  flush();
+  GLState::bindBuffer(target, ID);
+  glBufferData(target, capacity, NULL, GL_STREAM_DRAW);
+  released = written;
+}
+
+void StreamBuffer::retire(bool wait)
+{
+  while (!inFlight.empty()) {
+    const Region &region = inFlight.front();
+    GLuint64 timeout = wait ? 1000000000ull : 0;
+    GLenum status =
+        glClientWaitSync(region.sync, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    // give a stuck GPU a few seconds, then stop waiting on the fence
+    for (int attempt = 1; status == GL_TIMEOUT_EXPIRED && wait &&
+                          attempt < RETIRE_WAIT_ATTEMPTS; attempt++)
+      status = glClientWaitSync(region.sync, 0, timeout);
+    if (status == GL_TIMEOUT_EXPIRED && !wait)
+      return;
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      // the fence can't say when GL is done with the region, so make sure
+      // it is before handing the memory out again
+      std::cout << (status == GL_WAIT_FAILED
+                        ? "ERROR::STREAM_BUFFER::WAIT_FAILED"
+                        : "ERROR::STREAM_BUFFER::WAIT_TIMEOUT")
+                << std::endl;
+      glFinish();
+    }
+    glDeleteSync(region.sync);
+    released = region.end;
+    inFlight.pop_front();
+    // one region is enough room for the caller to check again
+    if (wait)
+      return;
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// A ring of buffer memory for data that changes every frame: per-object
+// matrices, per-frame uniforms, indirect commands. Allocations are written
+// in place and read by GL at their offset, e.g. bound with bindRange().
+//
+// With GL 4.4 the buffer is mapped once, persistent and coherent, so writes
+// go straight to memory GL reads from. A fence after each frame's draws
+// guards the regions still in flight; allocate() only waits if the ring
+// wraps onto one. Older contexts write to a copy that flush() uploads, and
+// the buffer is orphaned at every fence instead.
+class StreamBuffer
+{
+public:
+  // the buffer ID, fixed for the lifetime of the ring
+  unsigned int ID;
+
+  // target is what the buffer is bound to, e.g. GL_UNIFORM_BUFFER. size is
+  // the whole ring, make it a few frames' worth.
+  StreamBuffer(GLenum target, size_t size);
+  ~StreamBuffer();
+  StreamBuffer(const StreamBuffer &) = delete;
+  StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+  // true if the context can map buffers persistently
+  static bool isPersistentSupported();
+
+  // room for size bytes starting at a multiple of alignment. Returns where
+  // to write them and sets offset to where GL finds them, or returns NULL if
+  // size doesn't fit next to what is still in use.
+  void* allocate(size_t size, size_t alignment, size_t &offset);
+  // make everything written since the last flush visible to GL. Needed
+  // before a draw reads it; nothing to do when mapped.
+  void flush();
+  // bind [offset, offset + size) to an indexed binding point of the target
+  void bindRange(unsigned int index, size_t offset, size_t size);
+  // call after the draws that read everything allocated so far, usually
+  // once per frame
+  void fence();
+
+private:
+  // the end of the allocations one fence protects, in bytes ever allocated
+  struct Region
+  {
+    GLsync sync;
+    uint64_t end;
+  };
+
+  GLenum target;
+  size_t capacity;
+  bool persistent;
+  // the mapping, or the copy flush() uploads from
+  unsigned char* memory;
+  std::vector<unsigned char> staging;
+  // byte counters that only grow; the ring offset is counter % capacity.
+  // [released, written) may still be read by GL, [flushed, written) hasn't
+  // been uploaded yet.
+  uint64_t written;
+  uint64_t released;
+  uint64_t flushed;
+  std::deque<Region> inFlight;
+
+  // forget the regions GL is done with, waiting for the oldest if wait
+  void retire(bool wait);
+  void upload(uint64_t begin, uint64_t end);
+};
+#endif
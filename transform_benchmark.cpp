@@ -0,0 +1,77 @@
+// Spins every node of a million node hierarchy each pass, then updates it
+// and writes the per-instance matrices of all nodes into one contiguous
+// buffer, on one thread and on doubling numbers of them up to one per
+// core. Prints the time per pass and the speedup over one thread. Not a
+// test, the numbers only mean something in an optimized build.
+//   transform_benchmark [objects] [passes]
+#include "transform_hierarchy.h"
+#include "worker_pool.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+  size_t objectCount = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  int passes = argc > 2 ? atoi(argv[2]) : 10;
+
+  // groups of a parent and 15 children, like objects carried by others
+  TransformHierarchy scene;
+  std::vector<int> nodes;
+  srand(1);
+  int parent = TransformHierarchy::NO_PARENT;
+  for (size_t i = 0; i < objectCount; i++) {
+    int node = scene.create(i % 16 == 0 ? TransformHierarchy::NO_PARENT
+                                        : parent);
+    if (i % 16 == 0)
+      parent = node;
+    glm::vec3 position(rand(), rand(), rand());
+    scene.setPosition(node, position / (float)RAND_MAX * 100.0f);
+    nodes.push_back(node);
+  }
+  scene.update();
+
+  // the shape's decode, as triangle puts after the world matrix
+  glm::mat4 decode(0.5f);
+  decode[3] = glm::vec4(0.1f, 0.2f, 0.3f, 1.0f);
+  std::vector<glm::mat4> models(objectCount);
+
+  unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+  double single = 0.0;
+  for (unsigned int threads = 1;; threads = std::min(threads * 2, cores)) {
+    WorkerPool workers(threads);
+    double best = 1e30;
+    for (int pass = 0; pass < passes; pass++) {
+      glm::quat spin = glm::angleAxis(0.01f * pass,
+                                      glm::normalize(glm::vec3(1.0f)));
+      for (int node : nodes)
+        scene.setRotation(node, spin);
+
+      std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      scene.update(workers);
+      workers.parallelFor(objectCount, 1024,
+                          [&](size_t begin, size_t end) {
+                            for (size_t i = begin; i < end; i++)
+                              models[i] = scene.getWorld(nodes[i]) * decode;
+                          });
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      best = std::min(best, elapsed.count());
+    }
+    if (threads == 1)
+      single = best;
+    std::cout << threads << " threads: " << best << " ms for " << objectCount
+              << " objects, " << single / best << "x" << std::endl;
+    if (threads == cores)
+      break;
+  }
+  return 0;
+}
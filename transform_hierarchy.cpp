@@ -0,0 +1,282 @@
+#include "transform_hierarchy.h"
+
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+// nodes per batch when updating on several threads, a few microseconds of
+// work that make the handing out worth it
+const size_t UPDATE_BATCH = 512;
+
+// v[i] becomes the old v[order[i]]
+template <typename T>
+void permute(std::vector<T> &v, const std::vector<int> &order)
+{
+  std::vector<T> result;
+  result.reserve(order.size());
+  for (int i : order)
+    result.push_back(v[i]);
+  v.swap(result);
+}
+}
+
+TransformHierarchy::TransformHierarchy() : firstDirty(0), sorted(true) {}
+
+int TransformHierarchy::create(int parent)
+{
+  int id;
+  if (!freeIds.empty()) {
+    id = freeIds.back();
+    freeIds.pop_back();
+  } else {
+    id = (int)slots.size();
+    slots.push_back(-1);
+  }
+
+  size_t slot = nodeIds.size();
+  int parentSlot = parent == NO_PARENT ? NO_PARENT : slots[parent];
+  int depth = parentSlot == NO_PARENT ? 0 : depths[parentSlot] + 1;
+  // appending keeps the order unless a deeper node is last
+  if (!depths.empty() && depths.back() > depth)
+    sorted = false;
+  nodeIds.push_back(id);
+  parents.push_back(parentSlot);
+  depths.push_back(depth);
+  positions.push_back(glm::vec3(0.0f));
+  rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+  scales.push_back(glm::vec3(1.0f));
+  worlds.push_back(glm::mat4(1.0f));
+  dirty.push_back(0);
+  slots[id] = (int)slot;
+  markDirty(slot);
+  return id;
+}
+
+void TransformHierarchy::destroy(int node)
+{
+  // in depth order everything below node comes after it
+  if (!sorted)
+    sortByDepth();
+  size_t first = slots[node];
+  std::vector<unsigned char> dropped(nodeIds.size(), 0);
+  std::vector<int> kept;
+  kept.reserve(nodeIds.size());
+  for (size_t slot = 0; slot < nodeIds.size(); slot++) {
+    int parent = parents[slot];
+    dropped[slot] = slot == first || (slot > first && parent != NO_PARENT &&
+                                      dropped[parent]);
+    if (dropped[slot]) {
+      slots[nodeIds[slot]] = -1;
+      freeIds.push_back(nodeIds[slot]);
+    } else {
+      kept.push_back((int)slot);
+    }
+  }
+  reorder(kept);
+}
+
+bool TransformHierarchy::setParent(int node, int parent)
+{
+  int slot = slots[node];
+  int parentSlot = parent == NO_PARENT ? NO_PARENT : slots[parent];
+  for (int ancestor = parentSlot; ancestor != NO_PARENT;
+       ancestor = parents[ancestor]) {
+    if (ancestor == slot) {
+      std::cout << "ERROR::TRANSFORM_HIERARCHY::CYCLE node " << node
+                << " can't go below " << parent << std::endl;
+      return false;
+    }
+  }
+  parents[slot] = parentSlot;
+  // the depths of node and its subtree are worked out again on sorting
+  sorted = false;
+  markDirty(slot);
+  return true;
+}
+
+int TransformHierarchy::getParent(int node) const
+{
+  int parentSlot = parents[slots[node]];
+  return parentSlot == NO_PARENT ? NO_PARENT : nodeIds[parentSlot];
+}
+
+void TransformHierarchy::setPosition(int node, const glm::vec3 &position)
+{
+  positions[slots[node]] = position;
+  markDirty(slots[node]);
+}
+
+void TransformHierarchy::setRotation(int node, const glm::quat &rotation)
+{
+  rotations[slots[node]] = rotation;
+  markDirty(slots[node]);
+}
+
+void TransformHierarchy::setScale(int node, const glm::vec3 &scale)
+{
+  scales[slots[node]] = scale;
+  markDirty(slots[node]);
+}
+
+const glm::vec3 &TransformHierarchy::getPosition(int node) const
+{
+  return positions[slots[node]];
+}
+
+const glm::quat &TransformHierarchy::getRotation(int node) const
+{
+  return rotations[slots[node]];
+}
+
+const glm::vec3 &TransformHierarchy::getScale(int node) const
+{
+  return scales[slots[node]];
+}
+
+size_t TransformHierarchy::update()
+{
+  if (!sorted)
+    sortByDepth();
+  // a parent comes first, so one pass does it
+  updateRange(firstDirty, nodeIds.size());
+  return finishUpdate();
+}
+
+size_t TransformHierarchy::update(WorkerPool &workers)
+{
+  if (!sorted)
+    sortByDepth();
+  // a depth has to be done before the next one reads it
+  size_t count = nodeIds.size();
+  for (size_t begin = firstDirty; begin < count;) {
+    size_t end = std::upper_bound(depths.begin() + begin, depths.end(),
+                                  depths[begin]) - depths.begin();
+    workers.parallelFor(end - begin, UPDATE_BATCH,
+                        [this, begin](size_t first, size_t last) {
+                          updateRange(begin + first, begin + last);
+                        });
+    begin = end;
+  }
+  return finishUpdate();
+}
+
+const glm::mat4 &TransformHierarchy::getWorld(int node) const
+{
+  return worlds[slots[node]];
+}
+
+const std::vector<int> &TransformHierarchy::getUpdated() const
+{
+  return updated;
+}
+
+size_t TransformHierarchy::size() const
+{
+  return nodeIds.size();
+}
+
+void TransformHierarchy::markDirty(size_t slot)
+{
+  dirty[slot] = 1;
+  size_t first = firstDirty.load(std::memory_order_relaxed);
+  while (slot < first &&
+         !firstDirty.compare_exchange_weak(first, slot,
+                                           std::memory_order_relaxed))
+    ;
+}
+
+void TransformHierarchy::updateRange(size_t begin, size_t end)
+{
+  // a parent's flag is final by the time its children look at it; they
+  // take it over and pass it on
+  for (size_t slot = begin; slot < end; slot++) {
+    int parent = parents[slot];
+    if (!dirty[slot]) {
+      if (parent == NO_PARENT || !dirty[parent])
+        continue;
+      dirty[slot] = 1;
+    }
+    // translate * rotate * scale
+    glm::mat4 local = glm::mat4_cast(rotations[slot]);
+    local[0] = local[0] * scales[slot].x;
+    local[1] = local[1] * scales[slot].y;
+    local[2] = local[2] * scales[slot].z;
+    local[3] = glm::vec4(positions[slot], 1.0f);
+    worlds[slot] = parent == NO_PARENT ? local : worlds[parent] * local;
+  }
+}
+
+size_t TransformHierarchy::finishUpdate()
+{
+  updated.clear();
+  for (size_t slot = firstDirty; slot < nodeIds.size(); slot++) {
+    if (dirty[slot]) {
+      updated.push_back(nodeIds[slot]);
+      dirty[slot] = 0;
+    }
+  }
+  firstDirty = nodeIds.size();
+  return updated.size();
+}
+
+void TransformHierarchy::sortByDepth()
+{
+  // depths from scratch, walking up to the nearest node that has one
+  size_t count = nodeIds.size();
+  std::fill(depths.begin(), depths.end(), -1);
+  std::vector<int> chain;
+  int maxDepth = 0;
+  for (size_t slot = 0; slot < count; slot++) {
+    chain.clear();
+    int node = (int)slot;
+    while (node != NO_PARENT && depths[node] < 0) {
+      chain.push_back(node);
+      node = parents[node];
+    }
+    int depth = node == NO_PARENT ? -1 : depths[node];
+    while (!chain.empty()) {
+      depths[chain.back()] = ++depth;
+      chain.pop_back();
+    }
+    maxDepth = std::max(maxDepth, depths[slot]);
+  }
+
+  // a counting sort, stable so siblings keep their order
+  std::vector<size_t> starts(maxDepth + 2, 0);
+  for (size_t slot = 0; slot < count; slot++)
+    starts[depths[slot] + 1]++;
+  for (size_t depth = 1; depth < starts.size(); depth++)
+    starts[depth] += starts[depth - 1];
+  std::vector<int> oldSlots(count);
+  for (size_t slot = 0; slot < count; slot++)
+    oldSlots[starts[depths[slot]]++] = (int)slot;
+  reorder(oldSlots);
+  sorted = true;
+}
+
+void TransformHierarchy::reorder(const std::vector<int> &oldSlots)
+{
+  std::vector<int> newSlots(nodeIds.size(), -1);
+  for (size_t slot = 0; slot < oldSlots.size(); slot++)
+    newSlots[oldSlots[slot]] = (int)slot;
+
+  permute(nodeIds, oldSlots);
+  permute(parents, oldSlots);
+  permute(depths, oldSlots);
+  permute(positions, oldSlots);
+  permute(rotations, oldSlots);
+  permute(scales, oldSlots);
+  permute(worlds, oldSlots);
+  permute(dirty, oldSlots);
+
+  firstDirty = nodeIds.size();
+  for (size_t slot = 0; slot < nodeIds.size(); slot++) {
+    if (parents[slot] != NO_PARENT)
+      parents[slot] = newSlots[parents[slot]];
+    slots[nodeIds[slot]] = (int)slot;
+    if (dirty[slot] && firstDirty == nodeIds.size())
+      firstDirty = slot;
+  }
+}
@@ -0,0 +1,94 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+class WorkerPool;
+
+// Positions, rotations and scales of scene nodes, each relative to its
+// parent, and the world matrices that follow from them. Every part is its
+// own array and the arrays are sorted by depth, so a parent always comes
+// before its children and update() is one pass from front to back.
+//
+// Setting a local transform marks the node dirty; update() recomputes the
+// world matrices of the dirty nodes and everything below them, and nothing
+// else. With no changes it does no matrix work at all.
+//
+// Nodes on one depth don't depend on each other, so with a WorkerPool
+// update() splits every depth across the threads.
+//
+// Nodes are known by an id that stays the same while the arrays are
+// reordered underneath.
+class TransformHierarchy
+{
+public:
+  static const int NO_PARENT = -1;
+
+  TransformHierarchy();
+
+  // a node at its parent's origin, unrotated and unscaled. Returns its id.
+  int create(int parent = NO_PARENT);
+  // destroy node and everything below it
+  void destroy(int node);
+  // keeps the local transform, so the node moves with its new parent.
+  // Returns false if parent is node or below it.
+  bool setParent(int node, int parent);
+  int getParent(int node) const;
+
+  // these three may run on several threads at once, as long as no two set
+  // the same node and nothing else uses the hierarchy meanwhile
+  void setPosition(int node, const glm::vec3 &position);
+  void setRotation(int node, const glm::quat &rotation);
+  void setScale(int node, const glm::vec3 &scale);
+  const glm::vec3 &getPosition(int node) const;
+  const glm::quat &getRotation(int node) const;
+  const glm::vec3 &getScale(int node) const;
+
+  // bring the world matrices up to date. Returns how many were recomputed.
+  size_t update();
+  // same, one depth after another on all threads of workers
+  size_t update(WorkerPool &workers);
+  // as of the last update()
+  const glm::mat4 &getWorld(int node) const;
+  // the ids of the nodes the last update() recomputed, parents first
+  const std::vector<int> &getUpdated() const;
+  size_t size() const;
+
+private:
+  // per slot, in depth order
+  std::vector<int> nodeIds;
+  std::vector<int> parents;
+  std::vector<int> depths;
+  std::vector<glm::vec3> positions;
+  std::vector<glm::quat> rotations;
+  std::vector<glm::vec3> scales;
+  std::vector<glm::mat4> worlds;
+  std::vector<unsigned char> dirty;
+
+  // per id: the slot, or -1 while the id is free
+  std::vector<int> slots;
+  std::vector<int> freeIds;
+  // no slot before this one is dirty; size() if none is. Atomic so that
+  // the setters can lower it from several threads.
+  std::atomic<size_t> firstDirty;
+  // false once a node may come before its parent
+  bool sorted;
+  std::vector<int> updated;
+
+  void markDirty(size_t slot);
+  // recompute the dirty slots of [begin, end), whose parents are up to date
+  void updateRange(size_t begin, size_t end);
+  // list what updateRange() recomputed and clear the flags
+  size_t finishUpdate();
+  // restore the depth order after create() or setParent() broke it
+  void sortByDepth();
+  // move every array to the order of oldSlots, which lists the old slot of
+  // each new one; slots missing from it are dropped
+  void reorder(const std::vector<int> &oldSlots);
+};
+#endif
@@ -1,18 +1,38 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <math.h>
+#include <vector>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "aabb_tree.h"
+#include "frustum_culler.h"
+#include "gl_state.h"
+#include "mesh_file.h"
+#include "mesh_pool.h"
+#include "multi_draw_renderer.h"
+#include "program_cache.h"
 // Shader class
 #include "shader.h"
+#include "shader_preprocessor.h"
+#include "shader_variants.h"
+#include "stream_buffer.h"
+#include "transform_hierarchy.h"
+#include "worker_pool.h"
+#include "vertex_array_cache.h"
+#include "vertex_format.h"
+// the .glsl files, compiled in by embed_shaders.cmake
+#include "embedded_shaders.h"
 #include "stb_image.h"
 
 // Camera class
 #include "camera.h"
 
+int run(GLFWwindow* window, int argc, char** argv);
 void processInput(GLFWwindow *window);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -32,11 +52,50 @@ float fov = 45.0f;
 // stores how much we're seeing of either texture
 float mixValue = 0.2f;
 
+// P stops the objects spinning and starts them again. Standing still they
+// cost no matrix work.
+bool spinning = true;
+bool pauseKeyDown = false;
+
 // deltaTime for constant speed
 float deltaTime = 0.0f; // Time between current frame and last frame
 float lastFrame = 0.0f; // Time of last frame
 
-int main(){
+// std140 layout of the CameraMatrices block in shader-vertex.glsl
+struct CameraMatrices
+{
+  glm::mat4 projection;
+  glm::mat4 view;
+};
+const unsigned int CAMERA_MATRICES_BINDING = 0;
+// frames of camera matrices the stream buffer holds before it wraps
+const size_t CAMERA_STREAM_FRAMES = 3;
+
+// time per frame spent building the shader variants nobody has drawn with yet
+const double SHADER_COMPILE_BUDGET_MS = 2.0;
+
+// object count when none is given on the command line
+const size_t DEFAULT_OBJECT_COUNT = 10;
+// how far an object moves or turns before its leaf in the culling tree
+// changes, and how many moved leaves are reinserted per frame
+const float CULLING_MARGIN = 0.1f;
+const size_t CULLING_REBALANCE_BUDGET = 256;
+// frames between renumbering the tree's nodes for the queries
+const unsigned int CULLING_LAYOUT_INTERVAL = 600;
+// objects per batch when the matrices and boxes are worked out on all cores
+const size_t OBJECT_BATCH = 256;
+// the meshes of the scene
+enum Shape { CUBE, PYRAMID, SHAPE_COUNT };
+// where the build puts the .mesh files, the working directory if not set
+#ifndef MESH_DIRECTORY
+#define MESH_DIRECTORY ""
+#endif
+// where the program binaries are cached, likewise set by the build
+#ifndef PROGRAM_CACHE_DIRECTORY
+#define PROGRAM_CACHE_DIRECTORY "shader-cache"
+#endif
+
+int main(int argc, char** argv){
 
   //Initialize the parameters
   // ------------------------
@@ -70,56 +129,71 @@ int main(){
   if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
   {
     std::cout << "Failed to initialize GLAD" << std::endl;
+    glfwTerminate();
     return -1;
   }
-  // declare shader, read from file, compile and link
-  Shader ourShader("shader-vertex.glsl", "shader-fragment.glsl");
+
+  // everything that owns GL objects lives in run(), so it is all deleted
+  // while the context still exists
+  int result = run(window, argc, argv);
+
+  // glfw: terminate, clearing all previously allocated GLFW resources.
+  // ------------------------------------------------------------------
+  glfwTerminate();
+  return result;
+}
+
+int run(GLFWwindow* window, int argc, char** argv)
+{
+  // let the driver compile shaders on several threads if it can
+  Shader::enableParallelCompile((GLADloadproc)glfwGetProcAddress);
+  // build the programs across the first frames instead of before the first
+  Shader::setLazyCompile(true);
+
+  // camera matrices shared by all programs, registered before the programs
+  // so they pick up the binding when they link. Every frame writes a fresh
+  // copy into the stream buffer and binds that range.
+  Shader::setBlockBinding("CameraMatrices", CAMERA_MATRICES_BINDING);
+  int uniformAlignment = 1;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+  size_t cameraSlot = (sizeof(CameraMatrices) + uniformAlignment - 1) /
+                      uniformAlignment * uniformAlignment;
+  StreamBuffer cameraStream(GL_UNIFORM_BUFFER,
+                            CAMERA_STREAM_FRAMES * cameraSlot);
+
+  // declare shader, read from file, queue for compiling. One variant per
+  // combination of sampled textures, so the fragment shader never fetches
+  // a texture that mixValue hides completely.
+  std::vector<std::string> features;
+  features.push_back("SAMPLE_TEXTURE1");
+  features.push_back("SAMPLE_TEXTURE2");
+  // The sources are compiled into the binary, set
+  // LEARNOPENGL_SHADERS_FROM_FILES to read and hot reload the .glsl files in
+  // the working directory instead.
+  if (getenv("LEARNOPENGL_SHADERS_FROM_FILES"))
+    ShaderPreprocessor::setPreferFiles(true);
+  // The program binaries live in the build tree, wherever triangle is
+  // started from. LEARNOPENGL_SHADER_CACHE names another directory; set it
+  // empty to turn the cache off, and with it the last file access for
+  // shaders at startup.
+  const char* cacheDirectory = getenv("LEARNOPENGL_SHADER_CACHE");
+  ProgramCache::setDirectory(cacheDirectory ? cacheDirectory
+                                            : PROGRAM_CACHE_DIRECTORY);
+  ShaderVariants ourShaders(shader_vertex_glsl, shader_fragment_glsl,
+                            features);
+  ourShaders.compileAll();
+  unsigned int sampleTexture1 = ourShaders.featureBit("SAMPLE_TEXTURE1");
+  unsigned int sampleTexture2 = ourShaders.featureBit("SAMPLE_TEXTURE2");
+  // pick up edits to the .glsl files without restarting
+  ourShaders.watch();
 
   // set up vertex data (and buffer(s)) and configure vertex attributes
   //-------------------------------------------------------------------
-  float vertices[] = {
-      -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-       0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-       0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-       0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-      -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-      -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-
-      -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-       0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-       0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-       0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-      -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-      -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-
-      -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-      -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-      -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-      -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-      -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-      -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-       0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-       0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-       0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-       0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-       0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-       0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-      -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-       0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-       0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-       0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-      -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-      -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-
-      -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-       0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-       0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-       0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-      -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-      -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
-  };
+  // the meshes come as .mesh files that mesh_converter built from the .obj
+  // files, welded, ordered for the vertex cache and quantized already. They
+  // are mapped and go to GL as they are, see MeshFile.
+  const char* shapeNames[SHAPE_COUNT] = {"cube", "pyramid"};
+  MeshFile shapeFiles[SHAPE_COUNT];
 
   glm::vec3 cubePositions[] = {
     glm::vec3( 0.0f,  0.0f,  0.0f),
@@ -134,33 +208,64 @@ int main(){
     glm::vec3(-1.3f,  1.0f, -1.5f)
   };
 
-  unsigned int VBO, VAO;
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-
-  // Bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes
-  glBindVertexArray(VAO);
-
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof (vertices), vertices, GL_STATIC_DRAW);
-
   // set vertex attribute values
   //----------------------------
-  // position attribute
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
-  glEnableVertexAttribArray(0);
-
-  // texture attribute
-  // imp: set the attribute to the correct 'location', which is the first argument
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
-                        (void *)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
-
-  // unbind -note that this is allowed, the call to glVertexAttribPointer registered VBO as the vertex attribute's bound vertex buffer object so afterwards we can safely unbind
-  glBindBuffer(GL_ARRAY_BUFFER,0);
-  // You can unbind the VAO afterwards so other VAO calls won't accidentally modify this VAO, but this rarely happens. Modifying other
-  // VAOs requires a call to glBindVertexArray anyways so we generally don't unbind VAOs (nor VBOs) when it's not directly necessary.
-  glBindVertexArray(0);
+  // the float layout mesh_converter starts from, its quantized form is the
+  // one of the .mesh files. Matched against the shader's inputs by name.
+  // The VAO of a variant is resolved the first frame it is drawn and again
+  // after a reload, the loop only binds it; variants that put the inputs at
+  // the same locations share one.
+  VertexFormat meshFormat;
+  meshFormat.add("aPos", 3, GL_FLOAT).add("aTexCoord", 2, GL_FLOAT);
+  VertexArrayCache vertexArrays;
+  std::vector<unsigned int> variantArrays(ourShaders.variantCount(), 0);
+  std::vector<bool> variantArraysResolved(ourShaders.variantCount(), false);
+
+  // every mesh in one pair of buffers, so one VAO draws them all. A shape
+  // whose file is missing stays empty.
+  VertexQuantizer quantizer(meshFormat);
+  MeshPool meshes(quantizer);
+  MeshRange shapes[SHAPE_COUNT] = {};
+  // the box around the mesh, in model space
+  glm::vec3 shapeCenter[SHAPE_COUNT], shapeHalfExtent[SHAPE_COUNT];
+  for (int shape = 0; shape < SHAPE_COUNT; shape++) {
+    std::string path =
+        std::string(MESH_DIRECTORY) + shapeNames[shape] + ".mesh";
+    if (!shapeFiles[shape].open(path))
+      continue;
+    shapes[shape] = meshes.add(shapeFiles[shape]);
+    shapeCenter[shape] = (shapeFiles[shape].getBoundsMin() +
+                          shapeFiles[shape].getBoundsMax()) * 0.5f;
+    shapeHalfExtent[shape] = (shapeFiles[shape].getBoundsMax() -
+                              shapeFiles[shape].getBoundsMin()) * 0.5f;
+    std::cout << "Mesh " << shapeNames[shape] << ": "
+              << shapeFiles[shape].getVertexCount() << " vertices, "
+              << shapeFiles[shape].getIndexCount() << " indices, "
+              << quantizer.getFormat().getStride() << " bytes per vertex"
+              << std::endl;
+  }
+  meshes.upload();
+  for (int shape = 0; shape < SHAPE_COUNT; shape++)
+    shapeFiles[shape].close();
+  // one draw covers every shape, so they have to agree on how texture
+  // coordinates are decoded. Coordinates inside [0, 1] always do.
+  glm::vec4 texCoordDecode = shapes[CUBE].decode.getTexCoordDecode();
+  for (int shape = 0; shape < SHAPE_COUNT; shape++)
+    if (shapes[shape].decode.getTexCoordDecode() != texCoordDecode)
+      std::cout << "ERROR::MESH::TEXCOORD_DECODE_MISMATCH "
+                << shapeNames[shape] << std::endl;
+
+  // the scene: the cubes of cubePositions, or as many objects as the first
+  // argument asks for, e.g. "triangle 100000"
+  size_t objectCount = DEFAULT_OBJECT_COUNT;
+  if (argc > 1)
+    objectCount = strtoul(argv[1], NULL, 10);
+
+  // the model matrices, one per object, advance per instance
+  MultiDrawRenderer renderer("aModel", objectCount);
+  std::vector<VertexStream> meshStreams;
+  meshStreams.push_back(meshes.getStream());
+  meshStreams.push_back(renderer.getStream());
 
   // uncomment this call to draw in wireframe polygons.
   //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -172,8 +277,7 @@ int main(){
   glGenTextures(1, &texture1);
 
   // Bind texture
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture1);
+  GLState::bindTexture(0, GL_TEXTURE_2D, texture1);
 
   // set the texture wrapping parameters
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -204,8 +308,7 @@ int main(){
   glGenTextures(1, &texture2);
 
   // Bind texture
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, texture2);
+  GLState::bindTexture(1, GL_TEXTURE_2D, texture2);
 
   // set the texture wrapping parameters
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -226,45 +329,119 @@ int main(){
 
   stbi_image_free(data);
 
-  // tell opengl for each sampler to which texture unit
-  // it belongs to (only has to be done once)
-  // --------------------------------------------------
-  ourShader.use();
-  ourShader.setInt("texture1", 0);
-  ourShader.setInt("texture2", 1);
+  // resolve the uniforms once, outside the render loop
+  int texture1Loc = ourShaders.getUniformHandle("texture1");
+  int texture2Loc = ourShaders.getUniformHandle("texture2");
+  int mixValueLoc = ourShaders.getUniformHandle("mixValue");
+  int texCoordDecodeLoc = ourShaders.getUniformHandle("texCoordDecode");
 
-  glEnable(GL_DEPTH_TEST);
+  GLState::enable(GL_DEPTH_TEST);
   srand(glfwGetTime());
 
+  // lay out the scene: objects past cubePositions are scattered over a
+  // volume that grows with their number, every third one a pyramid
+  size_t fixedCount = sizeof(cubePositions) / sizeof(cubePositions[0]);
+  std::vector<glm::vec3> positions[SHAPE_COUNT];
+  positions[CUBE].assign(cubePositions,
+                         cubePositions + std::min(objectCount, fixedCount));
+  float extent = 4.0f * cbrtf((float)objectCount);
+  for (size_t i = positions[CUBE].size(); i < objectCount; i++) {
+    glm::vec3 position(rand(), rand(), rand());
+    position = position / (float)RAND_MAX * 2.0f - 1.0f;
+    positions[i % 3 == 2 ? PYRAMID : CUBE].push_back(
+        position * extent - glm::vec3(0.0f, 0.0f, extent));
+  }
+  float farPlane = std::max(100.0f, 3.0f * extent);
+
+  // every object is a node of the scene, objectShapes holds what it draws.
+  // Ids count up from 0 as long as nothing is destroyed.
+  TransformHierarchy scene;
+  // the per-object matrix and box work is split across every core
+  WorkerPool workers;
+  std::vector<AABB> updatedBoxes;
+  std::vector<int> objectShapes;
+  for (int shape = 0; shape < SHAPE_COUNT; shape++) {
+    for (const glm::vec3 &position : positions[shape]) {
+      int node = scene.create();
+      scene.setPosition(node, position);
+      objectShapes.push_back(shape);
+    }
+  }
+  scene.update();
+  float spinAngle = 0.0f;
+
+  // every object's box in one tree, culled against the view every frame.
+  // The user data is the node; visible gets the nodes that survive.
+  AABBTree cullingTree(CULLING_MARGIN);
+  std::vector<int> proxies(scene.size());
+  std::vector<unsigned int> visible[SHAPE_COUNT];
+  std::vector<unsigned int> found;
+  for (size_t node = 0; node < scene.size(); node++) {
+    int shape = objectShapes[node];
+    proxies[node] = cullingTree.insert(
+        AABB::transformed(shapeCenter[shape], shapeHalfExtent[shape],
+                          scene.getWorld((int)node)),
+        (unsigned int)node);
+  }
+  for (int shape = 0; shape < SHAPE_COUNT; shape++)
+    visible[shape].reserve(positions[shape].size());
+  cullingTree.optimizeLayout();
+  unsigned int framesSinceLayout = 0;
+  size_t visibleCount = 0;
+  size_t updatedCount = 0;
+
   while(!glfwWindowShouldClose(window))
   {
     // input
     //--------
     processInput(window);
 
+    // swap in the edited shaders, between frames. A relinked program may
+    // have moved its inputs, so the VAOs are resolved again.
+    if (ourShaders.reload())
+      std::fill(variantArraysResolved.begin(), variantArraysResolved.end(),
+                false);
+    // make progress on the variants that aren't built yet
+    Shader::compilePending(SHADER_COMPILE_BUDGET_MS);
+
     // render
     //-------
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture1);
-
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, texture2);
+    // bind textures on corresponding texture units, only reaches the driver
+    // if something else was bound in between
+    GLState::bindTexture(0, GL_TEXTURE_2D, texture1);
+    GLState::bindTexture(1, GL_TEXTURE_2D, texture2);
+
+    // choose the variant that samples only what mixValue makes visible
+    unsigned int mask = 0;
+    if (mixValue < 1.0f)
+      mask |= sampleTexture1;
+    if (mixValue > 0.0f)
+      mask |= sampleTexture2;
+    // a variant that isn't built yet is built right here
+    Shader &ourShader = ourShaders.get(mask);
+    if (!variantArraysResolved[mask]) {
+      variantArrays[mask] = vertexArrays.get(meshStreams, ourShader,
+                                             meshes.indexBuffer);
+      variantArraysResolved[mask] = true;
+    }
+    unsigned int VAO = variantArrays[mask];
 
-    // set the texture mix value in the shader
+    // tell opengl for each sampler to which texture unit it belongs to.
+    // Only the first frame a variant is drawn with (or after a reload)
+    // reaches the driver, the others are skipped.
     ourShader.use();
-    ourShader.setFloat("mixValue", mixValue);
+    ourShader.setInt(texture1Loc, 0);
+    ourShader.setInt(texture2Loc, 1);
+    // set the texture mix value in the shader
+    ourShader.setFloat(mixValueLoc, mixValue);
+    ourShader.setVec4(texCoordDecodeLoc, texCoordDecode.x, texCoordDecode.y,
+                      texCoordDecode.z, texCoordDecode.w);
 
     // Coordinate system: 3D view
 
-    // Model matrix
-    // ------------
-    glm::mat4 model(1.0f);
-    //model = glm::rotate(model, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-
     // View matrix
     //------------
     glm::mat4 view = camera.GetViewMatrix();
@@ -273,31 +450,98 @@ int main(){
     // -----------------
     glm::mat4 projection(1.0f);
     projection = glm::perspective(glm::radians(camera.Zoom), (float) SCREEN_WIDTH/
-                                  (float) SCREEN_HEIGHT, 0.1f, 100.0f);
+                                  (float) SCREEN_HEIGHT, 0.1f, farPlane);
 
-    // Set the matrices in the shader
+    // Set the matrices in the shader: view and projection are written to
+    // the stream buffer once per frame, however many programs read them
     // -----------------------------
-    ourShader.setMatrix("model", 1, 0, glm::value_ptr(model));
-    ourShader.setMatrix("view", 1, 0, glm::value_ptr(view));
-    ourShader.setMatrix("projection", 1, 0, glm::value_ptr(projection));
-
-    glBindVertexArray(VAO);
-    for(unsigned int i = 0; i < 10; i++) {
-      glm::mat4 model = glm::mat4(1.0f);
-      model = glm::translate(model, cubePositions[i]);
-      float r = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-      //if (i%1==0) {
-        model = glm::rotate(model, (float)glfwGetTime()/2.0f , glm::vec3(r, r, r));
-      //}
-      ourShader.setMatrix("model", 1, GL_FALSE, glm::value_ptr(model));
-      glDrawArrays(GL_TRIANGLES, 0, 36);
+    size_t cameraOffset;
+    CameraMatrices* cameraMatrices = (CameraMatrices*)cameraStream.allocate(
+        sizeof(CameraMatrices), uniformAlignment, cameraOffset);
+    if (cameraMatrices) {
+      cameraMatrices->projection = projection;
+      cameraMatrices->view = view;
+      cameraStream.flush();
+      cameraStream.bindRange(CAMERA_MATRICES_BINDING, cameraOffset,
+                             sizeof(CameraMatrices));
     }
+
+    // Model matrices
+    // --------------
+    // the world matrices of the nodes that moved, and their boxes, most of
+    // which still fit their fat boxes. Only the objects whose bounds touch
+    // the view get a model matrix.
+    if (spinning) {
+      spinAngle += deltaTime / 2.0f;
+      glm::quat spin = glm::angleAxis(spinAngle,
+                                      glm::normalize(glm::vec3(1.0f)));
+      workers.parallelFor(scene.size(), OBJECT_BATCH,
+                          [&](size_t begin, size_t end) {
+                            for (size_t node = begin; node < end; node++)
+                              scene.setRotation((int)node, spin);
+                          });
+    }
+    updatedCount = scene.update(workers);
+    // the tree takes one box at a time, but they are worked out in parallel
+    const std::vector<int> &updated = scene.getUpdated();
+    updatedBoxes.resize(updated.size());
+    workers.parallelFor(updated.size(), OBJECT_BATCH,
+                        [&](size_t begin, size_t end) {
+                          for (size_t i = begin; i < end; i++) {
+                            int shape = objectShapes[updated[i]];
+                            updatedBoxes[i] = AABB::transformed(
+                                shapeCenter[shape], shapeHalfExtent[shape],
+                                scene.getWorld(updated[i]));
+                          }
+                        });
+    for (size_t i = 0; i < updated.size(); i++)
+      cullingTree.update(proxies[updated[i]], updatedBoxes[i]);
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+    cullingTree.refit();
+    cullingTree.rebalance(CULLING_REBALANCE_BUDGET);
+    if (++framesSinceLayout == CULLING_LAYOUT_INTERVAL) {
+      cullingTree.optimizeLayout();
+      framesSinceLayout = 0;
+    }
+    found.clear();
+    cullingTree.queryFrustum(frustum, found);
+    for (int shape = 0; shape < SHAPE_COUNT; shape++)
+      visible[shape].clear();
+    for (unsigned int node : found)
+      visible[objectShapes[node]].push_back(node);
+    visibleCount = found.size();
+
+    renderer.begin();
+    for (int shape = 0; shape < SHAPE_COUNT; shape++) {
+      size_t count = visible[shape].size();
+      // the quantized positions are decoded by the model matrix
+      glm::mat4 decode = shapes[shape].decode.getPositionMatrix();
+      // written straight into the memory the draw reads from, each thread
+      // a run of it of its own
+      glm::mat4* models = renderer.add(shapes[shape], count);
+      if (!models)
+        continue;
+      const std::vector<unsigned int> &nodes = visible[shape];
+      workers.parallelFor(count, OBJECT_BATCH,
+                          [&](size_t begin, size_t end) {
+                            for (size_t i = begin; i < end; i++)
+                              models[i] =
+                                  scene.getWorld((int)nodes[i]) * decode;
+                          });
+    }
+
+    // every object of every shape in one draw call
+    GLState::bindVertexArray(VAO);
+    renderer.submit(ourShader);
+    // the camera range may be reused once this frame's draws are done
+    cameraStream.fence();
     // glBindVertexArray(0); // no need to unbind it every time
 
     // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
     // -------------------------------------------------------------------------------
     glfwSwapBuffers(window);
     glfwPollEvents();
+    GLState::endFrame();
 
     // update camera speed according to frame rate
     float currentFrame = glfwGetTime();
@@ -305,14 +549,27 @@ int main(){
     lastFrame = currentFrame;
   }
 
-  // optional: de-allocate all resources once they've outlived their purpose:
+  std::cout << "Objects drawn in the last frame: " << visibleCount << " of "
+            << objectCount << ", culled by a tree of height "
+            << cullingTree.getHeight() << ", " << updatedCount
+            << " world matrices recomputed on " << workers.getThreadCount()
+            << " threads" << std::endl;
+  Shader::UniformStats uniformStats = Shader::getUniformStats();
+  std::cout << "Uniform uploads: " << uniformStats.issued << " issued, "
+            << uniformStats.skipped << " skipped" << std::endl;
+  GLState::Stats frameStats = GLState::getFrameStats();
+  GLState::Stats totalStats = GLState::getTotalStats();
+  std::cout << "GL state calls in the last frame: " << frameStats.issued
+            << " issued, " << frameStats.elided << " elided; in total: "
+            << totalStats.issued << " issued, " << totalStats.elided
+            << " elided" << std::endl;
+
+  // de-allocate all resources once they've outlived their purpose; the
+  // rest goes with the locals of run(), before glfwTerminate()
   //-------------------------------------------------------------------------
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-
-  // glfw: terminate, clearing all previously allocated GLFW resources.
-  // ------------------------------------------------------------------
-  glfwTerminate();
+  vertexArrays.clear();
+  glDeleteTextures(1, &texture1);
+  glDeleteTextures(1, &texture2);
   return 0;
 }
 
@@ -334,6 +591,10 @@ void processInput(GLFWwindow *window)
       if (mixValue <= 0.0f)
           mixValue = 0.0f;
   }
+  bool pauseKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+  if (pauseKey && !pauseKeyDown)
+    spinning = !spinning;
+  pauseKeyDown = pauseKey;
   float cameraSpeed = 2.5f * deltaTime;
   if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
     camera.ProcessKeyboard(FORWARD, deltaTime);
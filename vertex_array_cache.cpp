@@ -0,0 +1,184 @@
+#include "vertex_array_cache.h"
+#include "gl_state.h"
+#include "hash.h"
+#include "shader.h"
+
+#include <iostream>
+
+namespace {
+bool isIntegerType(GLenum type)
+{
+  return type != GL_FLOAT && type != GL_HALF_FLOAT && type != GL_DOUBLE &&
+         !isPackedType(type);
+}
+
+// components per location and number of locations of a shader input type
+void shaderInputShape(GLenum type, int &components, int &columns,
+                      bool &isInteger)
+{
+  columns = 1;
+  isInteger = false;
+  switch (type) {
+  case GL_FLOAT: components = 1; break;
+  case GL_FLOAT_VEC2: components = 2; break;
+  case GL_FLOAT_VEC3: components = 3; break;
+  case GL_FLOAT_VEC4: components = 4; break;
+  case GL_FLOAT_MAT2: components = 2; columns = 2; break;
+  case GL_FLOAT_MAT3: components = 3; columns = 3; break;
+  case GL_FLOAT_MAT4: components = 4; columns = 4; break;
+  case GL_INT:
+  case GL_UNSIGNED_INT: components = 1; isInteger = true; break;
+  case GL_INT_VEC2:
+  case GL_UNSIGNED_INT_VEC2: components = 2; isInteger = true; break;
+  case GL_INT_VEC3:
+  case GL_UNSIGNED_INT_VEC3: components = 3; isInteger = true; break;
+  case GL_INT_VEC4:
+  case GL_UNSIGNED_INT_VEC4: components = 4; isInteger = true; break;
+  default: components = 4; break;
+  }
+}
+}
+
+VertexArrayCache::VertexArrayCache() {}
+
+VertexArrayCache::~VertexArrayCache()
+{
+  clear();
+}
+
+unsigned int VertexArrayCache::get(const VertexFormat &format,
+                                   const Shader &shader, unsigned int vbo,
+                                   unsigned int ebo)
+{
+  VertexStream stream = {&format, vbo};
+  return get(std::vector<VertexStream>(1, stream), shader, ebo);
+}
+
+unsigned int VertexArrayCache::get(const std::vector<VertexStream> &streams,
+                                   const Shader &shader, unsigned int ebo)
+{
+  // 1. match every shader input to an attribute of one of the streams
+  struct Binding
+  {
+    size_t stream;
+    const VertexAttribute* attribute;
+    int location;
+    int columns;
+    bool isInteger;
+  };
+  std::vector<Binding> bindings;
+  bool matches = true;
+  for (const Shader::Variable &input : shader.getAttributes()) {
+    // built-ins such as gl_VertexID have no location
+    if (input.location < 0)
+      continue;
+
+    int components, columns;
+    bool isInteger;
+    shaderInputShape(input.type, components, columns, isInteger);
+
+    const VertexAttribute* attribute = NULL;
+    size_t stream = 0;
+    for (size_t i = 0; i < streams.size() && !attribute; i++) {
+      const std::vector<VertexAttribute> &candidates =
+          streams[i].format->getAttributes();
+      for (const VertexAttribute &candidate : candidates)
+        if (candidate.name == input.name) {
+          attribute = &candidate;
+          stream = i;
+        }
+    }
+
+    if (!attribute) {
+      std::cout << "ERROR::VERTEX_ARRAY::MISSING_ATTRIBUTE " << input.name
+                << std::endl;
+      matches = false;
+      continue;
+    }
+    // vectors may be fed fewer components, GL fills in (0, 0, 0, 1), but a
+    // matrix has to be complete or the columns come out shifted
+    bool fits = columns > 1
+                    ? attribute->components == components * columns
+                    : attribute->components >= 1 && attribute->components <= 4;
+    if (!fits) {
+      std::cout << "ERROR::VERTEX_ARRAY::COMPONENT_MISMATCH " << input.name
+                << " format has " << attribute->components << ", shader takes "
+                << components * columns << std::endl;
+      matches = false;
+      continue;
+    }
+    if (isInteger && !isIntegerType(attribute->type)) {
+      std::cout << "ERROR::VERTEX_ARRAY::TYPE_MISMATCH " << input.name
+                << " is an integer input fed with floats" << std::endl;
+      matches = false;
+      continue;
+    }
+    bindings.push_back(
+        Binding{stream, attribute, input.location, columns, isInteger});
+  }
+  if (!matches)
+    return 0;
+
+  // 2. programs that agree on the locations can share the VAO
+  uint64_t key = hashBytes(&ebo, sizeof(ebo));
+  for (const VertexStream &stream : streams) {
+    uint64_t format = stream.format->getHash();
+    key = hashBytes(&format, sizeof(format), key);
+    key = hashBytes(&stream.vbo, sizeof(stream.vbo), key);
+  }
+  for (const Binding &binding : bindings) {
+    const VertexFormat &format = *streams[binding.stream].format;
+    int fields[3] = {binding.location, (int)binding.stream,
+                     (int)(binding.attribute - &format.getAttributes()[0])};
+    key = hashBytes(fields, sizeof(fields), key);
+  }
+
+  std::unordered_map<uint64_t, unsigned int>::const_iterator it =
+      vertexArrays.find(key);
+  if (it != vertexArrays.end())
+    return it->second;
+
+  // 3. build it
+  unsigned int vao;
+  glGenVertexArrays(1, &vao);
+  GLState::bindVertexArray(vao);
+  if (ebo != 0)
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+
+  for (const Binding &binding : bindings) {
+    // the pointers below capture the buffer bound at the time
+    const VertexStream &stream = streams[binding.stream];
+    GLState::bindBuffer(GL_ARRAY_BUFFER, stream.vbo);
+    GLsizei stride = (GLsizei)stream.format->getStride();
+    const VertexAttribute &attribute = *binding.attribute;
+    int components = attribute.components / binding.columns;
+    // a matrix input takes one location per column
+    for (int column = 0; column < binding.columns; column++) {
+      int location = binding.location + column;
+      const void* offset = (const void*)(attribute.offset +
+          column * components * getTypeSize(attribute.type));
+      if (binding.isInteger)
+        glVertexAttribIPointer(location, components, attribute.type, stride,
+                               offset);
+      else
+        glVertexAttribPointer(location,
+                              isPackedType(attribute.type) ? 4 : components,
+                              attribute.type, attribute.normalized, stride,
+                              offset);
+      glEnableVertexAttribArray(location);
+      if (stream.format->getDivisor() != 0)
+        glVertexAttribDivisor(location, stream.format->getDivisor());
+    }
+  }
+
+  GLState::bindVertexArray(0);
+  vertexArrays[key] = vao;
+  return vao;
+}
+
+void VertexArrayCache::clear()
+{
+  for (const std::pair<const uint64_t, unsigned int> &entry : vertexArrays)
+    GLState::deleteVertexArray(entry.second);
+  vertexArrays.clear();
+}
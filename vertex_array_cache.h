@@ -0,0 +1,39 @@
+#ifndef VERTEX_ARRAY_CACHE_H
+#define VERTEX_ARRAY_CACHE_H
+
+#include "vertex_format.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class Shader;
+
+// Builds vertex array objects by matching a VertexFormat against the active
+// attributes of a program, and keeps them. Programs that put the attributes
+// at the same locations share one VAO, so the variants of a shader cost a
+// single VAO. Build them at load time, get() is a hash lookup afterwards.
+class VertexArrayCache
+{
+public:
+  VertexArrayCache();
+  ~VertexArrayCache();
+  VertexArrayCache(const VertexArrayCache &) = delete;
+  VertexArrayCache &operator=(const VertexArrayCache &) = delete;
+
+  // the VAO that feeds shader from vbo (and ebo, if not 0) laid out as
+  // format. Returns 0 and prints why if the format doesn't fit the program,
+  // e.g. a shader input the format lacks or a component count mismatch.
+  unsigned int get(const VertexFormat &format, const Shader &shader,
+                   unsigned int vbo, unsigned int ebo = 0);
+  // same, with the inputs spread over several buffers. Each input is looked
+  // up in every stream, the first one that has it wins.
+  unsigned int get(const std::vector<VertexStream> &streams,
+                   const Shader &shader, unsigned int ebo = 0);
+  // delete every VAO built so far
+  void clear();
+
+private:
+  std::unordered_map<uint64_t, unsigned int> vertexArrays;
+};
+#endif
@@ -0,0 +1,75 @@
+#include "vertex_format.h"
+#include "hash.h"
+
+size_t getTypeSize(GLenum type)
+{
+  switch (type) {
+  case GL_BYTE:
+  case GL_UNSIGNED_BYTE:
+    return 1;
+  case GL_SHORT:
+  case GL_UNSIGNED_SHORT:
+  case GL_HALF_FLOAT:
+    return 2;
+  default:
+    return 4;
+  }
+}
+
+bool isPackedType(GLenum type)
+{
+  return type == GL_INT_2_10_10_10_REV || type == GL_UNSIGNED_INT_2_10_10_10_REV;
+}
+
+VertexFormat::VertexFormat() : stride(0), divisor(0) {}
+
+VertexFormat &VertexFormat::add(const std::string &name, int components,
+                                GLenum type, bool normalized)
+{
+  VertexAttribute attribute;
+  attribute.name = name;
+  attribute.components = components;
+  attribute.type = type;
+  attribute.normalized = normalized;
+  attribute.offset = stride;
+  attributes.push_back(attribute);
+
+  size_t size = isPackedType(type) ? 4 : components * getTypeSize(type);
+  // keep every attribute 4 byte aligned, drivers are slow with less
+  stride += (size + 3) & ~(size_t)3;
+  return *this;
+}
+
+VertexFormat &VertexFormat::setDivisor(unsigned int divisor)
+{
+  this->divisor = divisor;
+  return *this;
+}
+
+const std::vector<VertexAttribute> &VertexFormat::getAttributes() const
+{
+  return attributes;
+}
+
+size_t VertexFormat::getStride() const
+{
+  return stride;
+}
+
+unsigned int VertexFormat::getDivisor() const
+{
+  return divisor;
+}
+
+uint64_t VertexFormat::getHash() const
+{
+  uint64_t hash = hashBytes(&stride, sizeof(stride));
+  hash = hashBytes(&divisor, sizeof(divisor), hash);
+  for (const VertexAttribute &attribute : attributes) {
+    hash = hashBytes(attribute.name.data(), attribute.name.size(), hash);
+    int fields[4] = {attribute.components, (int)attribute.type,
+                     attribute.normalized ? 1 : 0, (int)attribute.offset};
+    hash = hashBytes(fields, sizeof(fields), hash);
+  }
+  return hash;
+}
@@ -0,0 +1,63 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+// only for GLenum and the type constants, nothing here calls GL
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// bytes per component of an attribute type, 4 for the packed types
+size_t getTypeSize(GLenum type);
+// true for the types that hold all their components in one 4 byte value
+bool isPackedType(GLenum type);
+
+// one interleaved attribute of a vertex buffer
+struct VertexAttribute
+{
+  // name of the matching "in" variable in the vertex shader
+  std::string name;
+  int components;
+  // GL_FLOAT, GL_UNSIGNED_SHORT, ...
+  GLenum type;
+  bool normalized;
+  size_t offset;
+};
+
+// Describes the layout of one interleaved vertex buffer. Attributes are
+// matched to the vertex shader by name, not by location, so the layout is
+// written once instead of mirroring layout(location=...) by hand.
+class VertexFormat
+{
+public:
+  VertexFormat();
+
+  // append an attribute right after the previous one
+  VertexFormat &add(const std::string &name, int components, GLenum type,
+                    bool normalized = false);
+  // advance the attributes once per divisor instances instead of once per
+  // vertex, 0 (the default) for per-vertex data
+  VertexFormat &setDivisor(unsigned int divisor);
+
+  const std::vector<VertexAttribute> &getAttributes() const;
+  size_t getStride() const;
+  unsigned int getDivisor() const;
+  // identifies the layout, equal formats hash equal
+  uint64_t getHash() const;
+
+private:
+  std::vector<VertexAttribute> attributes;
+  size_t stride;
+  unsigned int divisor;
+};
+
+// one vertex buffer of a VAO and its layout, e.g. per-vertex data in one
+// buffer and per-instance data in another
+struct VertexStream
+{
+  const VertexFormat* format;
+  unsigned int vbo;
+};
+#endif
@@ -0,0 +1,268 @@
+#include "vertex_quantizer.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace {
+// round to nearest, ties to even like F16C and glm::packHalf1x16, overflows
+// to infinity, small values become subnormal
+uint16_t floatToHalf(float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  uint32_t mantissa = bits & 0x7fffff;
+  if (((bits >> 23) & 0xff) == 0xff)
+    return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+  int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+  if (exponent >= 31)
+    return (uint16_t)(sign | 0x7c00);
+  if (exponent <= 0) {
+    if (exponent < -10)
+      return (uint16_t)sign;
+    mantissa |= 0x800000;
+    int shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    uint32_t dropped = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (dropped > halfway || (dropped == halfway && (half & 1)))
+      half++;
+    return (uint16_t)(sign | half);
+  }
+  // a carry out of the mantissa bumps the exponent, which is right
+  uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+  uint32_t dropped = mantissa & 0x1fff;
+  if (dropped > 0x1000 || (dropped == 0x1000 && (half & 1)))
+    half++;
+  return (uint16_t)half;
+}
+
+// GL 4.2 rules: snorm c maps to c / 32767, unorm c to c / 65535
+int16_t toSnorm16(float value)
+{
+  value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+  return (int16_t)floorf(value * 32767.0f + 0.5f);
+}
+
+uint16_t toUnorm16(float value)
+{
+  value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+  return (uint16_t)floorf(value * 65535.0f + 0.5f);
+}
+
+uint32_t packNormal(const float* normal)
+{
+  uint32_t packed = 0;
+  for (int i = 0; i < 3; i++) {
+    float value = normal[i];
+    value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+    int component = (int)floorf(value * 511.0f + 0.5f);
+    packed |= ((uint32_t)component & 0x3ff) << (10 * i);
+  }
+  return packed;
+}
+}
+
+VertexEncoding::VertexEncoding()
+    : position(POSITION_SNORM16), texCoord(TEXCOORD_UNORM16),
+      normal(NORMAL_PACKED), positionName("aPos"), texCoordName("aTexCoord"),
+      normalName("aNormal")
+{
+}
+
+VertexEncoding VertexEncoding::floats()
+{
+  VertexEncoding encoding;
+  encoding.position = POSITION_FLOAT;
+  encoding.texCoord = TEXCOORD_FLOAT;
+  encoding.normal = NORMAL_FLOAT;
+  return encoding;
+}
+
+MeshDecode::MeshDecode()
+    : positionScale(1.0f), positionBias(0.0f), texCoordScale(1.0f),
+      texCoordBias(0.0f)
+{
+}
+
+glm::mat4 MeshDecode::getPositionMatrix() const
+{
+  return glm::scale(glm::translate(glm::mat4(1.0f), positionBias),
+                    positionScale);
+}
+
+glm::vec4 MeshDecode::getTexCoordDecode() const
+{
+  return glm::vec4(texCoordScale, texCoordBias);
+}
+
+VertexQuantizer::VertexQuantizer(const VertexFormat &source,
+                                 const VertexEncoding &encoding)
+    : source(source), encoding(encoding)
+{
+  format.setDivisor(source.getDivisor());
+  for (const VertexAttribute &attribute : source.getAttributes()) {
+    Kind kind = COPY;
+    int components = 0;
+    if (attribute.name == encoding.positionName &&
+        encoding.position != VertexEncoding::POSITION_FLOAT) {
+      kind = POSITION;
+      components = 3;
+    } else if (attribute.name == encoding.texCoordName &&
+               encoding.texCoord != VertexEncoding::TEXCOORD_FLOAT) {
+      kind = TEXCOORD;
+      components = 2;
+    } else if (attribute.name == encoding.normalName &&
+               encoding.normal != VertexEncoding::NORMAL_FLOAT) {
+      kind = NORMAL;
+      components = 3;
+    }
+    if (kind != COPY && (attribute.type != GL_FLOAT ||
+                         attribute.components != components)) {
+      std::cout << "ERROR::VERTEX_QUANTIZER::UNSUPPORTED_ATTRIBUTE "
+                << attribute.name << " has to be " << components
+                << " floats, copied as is" << std::endl;
+      kind = COPY;
+    }
+
+    size_t targetOffset = format.getStride();
+    Field field = {kind, attribute.offset, targetOffset, 0};
+    switch (kind) {
+    case POSITION:
+      if (encoding.position == VertexEncoding::POSITION_HALF)
+        format.add(attribute.name, 3, GL_HALF_FLOAT);
+      else
+        format.add(attribute.name, 3, GL_SHORT, true);
+      break;
+    case TEXCOORD:
+      format.add(attribute.name, 2, GL_UNSIGNED_SHORT, true);
+      break;
+    case NORMAL:
+      format.add(attribute.name, 4, GL_INT_2_10_10_10_REV, true);
+      break;
+    case COPY:
+      format.add(attribute.name, attribute.components, attribute.type,
+                 attribute.normalized);
+      break;
+    }
+    fields.push_back(field);
+  }
+
+  // copied attributes keep their size, which is the gap to the next one
+  for (size_t i = 0; i < fields.size(); i++) {
+    size_t end = i + 1 < fields.size() ? fields[i + 1].sourceOffset
+                                       : source.getStride();
+    fields[i].size = end - fields[i].sourceOffset;
+  }
+}
+
+const VertexFormat &VertexQuantizer::getSourceFormat() const
+{
+  return source;
+}
+
+const VertexFormat &VertexQuantizer::getFormat() const
+{
+  return format;
+}
+
+Mesh VertexQuantizer::quantize(const Mesh &mesh, MeshDecode* decode) const
+{
+  size_t vertexCount = mesh.getVertexCount();
+  size_t stride = format.getStride();
+  Mesh result;
+  result.stride = stride;
+  result.indices = mesh.indices;
+  result.vertices.assign(vertexCount * stride, 0);
+
+  // 1. the range of every quantized attribute over the mesh
+  glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+  glm::vec2 texLow(FLT_MAX), texHigh(-FLT_MAX);
+  for (const Field &field : fields) {
+    if (field.kind != POSITION && field.kind != TEXCOORD)
+      continue;
+    for (size_t v = 0; v < vertexCount; v++) {
+      float value[3];
+      memcpy(value, &mesh.vertices[v * mesh.stride + field.sourceOffset],
+             (field.kind == POSITION ? 3 : 2) * sizeof(float));
+      if (field.kind == POSITION) {
+        low = glm::min(low, glm::vec3(value[0], value[1], value[2]));
+        high = glm::max(high, glm::vec3(value[0], value[1], value[2]));
+      } else {
+        texLow = glm::min(texLow, glm::vec2(value[0], value[1]));
+        texHigh = glm::max(texHigh, glm::vec2(value[0], value[1]));
+      }
+    }
+  }
+
+  // 2. scale and bias. Positions fill the snorm range around the box
+  // center. Texture coordinates are widened to whole repeats, so the wrap
+  // points stay exact and meshes inside [0, 1] all share the identity.
+  MeshDecode meshDecode;
+  // low > high where the format lacks the attribute
+  if (low.x <= high.x &&
+      encoding.position == VertexEncoding::POSITION_SNORM16) {
+    meshDecode.positionBias = (low + high) * 0.5f;
+    meshDecode.positionScale = (high - low) * 0.5f;
+    for (int i = 0; i < 3; i++)
+      if (meshDecode.positionScale[i] <= 0.0f)
+        meshDecode.positionScale[i] = 1.0f;
+  }
+  if (texLow.x <= texHigh.x) {
+    glm::vec2 first = glm::floor(texLow), last = glm::ceil(texHigh);
+    meshDecode.texCoordBias = first;
+    meshDecode.texCoordScale = glm::max(last - first, glm::vec2(1.0f));
+  }
+
+  // 3. encode
+  for (size_t v = 0; v < vertexCount; v++) {
+    const unsigned char* in = &mesh.vertices[v * mesh.stride];
+    unsigned char* out = &result.vertices[v * stride];
+    for (const Field &field : fields) {
+      float value[3];
+      switch (field.kind) {
+      case POSITION:
+        memcpy(value, in + field.sourceOffset, sizeof(value));
+        for (int i = 0; i < 3; i++) {
+          float stored = (value[i] - meshDecode.positionBias[i]) /
+                         meshDecode.positionScale[i];
+          if (encoding.position == VertexEncoding::POSITION_HALF) {
+            uint16_t half = floatToHalf(stored);
+            memcpy(out + field.targetOffset + i * 2, &half, 2);
+          } else {
+            int16_t snorm = toSnorm16(stored);
+            memcpy(out + field.targetOffset + i * 2, &snorm, 2);
+          }
+        }
+        break;
+      case TEXCOORD:
+        memcpy(value, in + field.sourceOffset, 2 * sizeof(float));
+        for (int i = 0; i < 2; i++) {
+          uint16_t unorm = toUnorm16((value[i] - meshDecode.texCoordBias[i]) /
+                                     meshDecode.texCoordScale[i]);
+          memcpy(out + field.targetOffset + i * 2, &unorm, 2);
+        }
+        break;
+      case NORMAL: {
+        memcpy(value, in + field.sourceOffset, sizeof(value));
+        uint32_t packed = packNormal(value);
+        memcpy(out + field.targetOffset, &packed, sizeof(packed));
+        break;
+      }
+      case COPY:
+        memcpy(out + field.targetOffset, in + field.sourceOffset, field.size);
+        break;
+      }
+    }
+  }
+
+  if (decode)
+    *decode = meshDecode;
+  return result;
+}
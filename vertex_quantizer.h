@@ -0,0 +1,89 @@
+#ifndef VERTEX_QUANTIZER_H
+#define VERTEX_QUANTIZER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "mesh_processor.h"
+#include "vertex_format.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// how VertexQuantizer stores positions, texture coordinates and normals
+struct VertexEncoding
+{
+  enum Position { POSITION_FLOAT, POSITION_HALF, POSITION_SNORM16 };
+  enum TexCoord { TEXCOORD_FLOAT, TEXCOORD_UNORM16 };
+  enum Normal { NORMAL_FLOAT, NORMAL_PACKED };
+
+  Position position;
+  TexCoord texCoord;
+  // 10-10-10-2, for unit vectors only
+  Normal normal;
+  // the shader inputs each one applies to, other inputs are copied as is
+  std::string positionName;
+  std::string texCoordName;
+  std::string normalName;
+
+  // the compact one: snorm16 positions, unorm16 texture coordinates and
+  // packed normals, for "aPos", "aTexCoord" and "aNormal"
+  VertexEncoding();
+  // everything stays float, quantize() only copies
+  static VertexEncoding floats();
+};
+
+// turns a quantized mesh's attributes back into its own units:
+// value = stored * scale + bias. Identity for float and half attributes.
+struct MeshDecode
+{
+  glm::vec3 positionScale;
+  glm::vec3 positionBias;
+  glm::vec2 texCoordScale;
+  glm::vec2 texCoordBias;
+
+  MeshDecode();
+  // the position decode as a matrix. Multiply the model matrix by it and the
+  // vertex shader needs no work for positions at all.
+  glm::mat4 getPositionMatrix() const;
+  // scale in xy, bias in zw, for the vertex shader's texCoordDecode
+  glm::vec4 getTexCoordDecode() const;
+};
+
+// Compresses float vertices: positions to half floats or to 16 bit snorm
+// inside the mesh's bounding box, texture coordinates to 16 bit unorm and
+// normals to 10-10-10-2. The GPU converts them back during the fetch, the
+// per-mesh scale and bias land in a MeshDecode. A position and UV vertex
+// shrinks from 20 to 12 bytes, one with a normal from 32 to 16.
+class VertexQuantizer
+{
+public:
+  // source is the float layout meshes come in
+  explicit VertexQuantizer(const VertexFormat &source,
+                           const VertexEncoding &encoding = VertexEncoding());
+
+  // the layout meshes come in, and the compressed one for the VAOs
+  const VertexFormat &getSourceFormat() const;
+  const VertexFormat &getFormat() const;
+  // compress mesh, laid out as the source format. Indices stay as they are.
+  // The scale and bias picked for this mesh go to decode.
+  Mesh quantize(const Mesh &mesh, MeshDecode* decode = NULL) const;
+
+private:
+  enum Kind { COPY, POSITION, TEXCOORD, NORMAL };
+  // one attribute, where it is read from and where it is written to
+  struct Field
+  {
+    Kind kind;
+    size_t sourceOffset;
+    size_t targetOffset;
+    // bytes, for COPY
+    size_t size;
+  };
+
+  VertexFormat source;
+  VertexFormat format;
+  VertexEncoding encoding;
+  std::vector<Field> fields;
+};
+#endif
@@ -0,0 +1,97 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+namespace {
+// batches per thread and job, enough that threads which get started late
+// or are interrupted still finish close together
+const size_t BATCHES_PER_THREAD = 4;
+}
+
+WorkerPool::WorkerPool(unsigned int threadCount)
+    : generation(0), busy(0), quit(false), job(NULL), count(0), batch(0),
+      next(0)
+{
+  if (threadCount == 0)
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned int i = 1; i < threadCount; i++)
+    threads.push_back(std::thread(&WorkerPool::run, this));
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  wake.notify_all();
+  for (std::thread &thread : threads)
+    thread.join();
+}
+
+unsigned int WorkerPool::getThreadCount() const
+{
+  return (unsigned int)threads.size() + 1;
+}
+
+void WorkerPool::parallelFor(size_t count, size_t minBatch, const Job &job)
+{
+  size_t batches = getThreadCount() * BATCHES_PER_THREAD;
+  size_t batch = std::max(std::max(minBatch, (size_t)1),
+                          (count + batches - 1) / batches);
+  if (count <= batch || threads.empty()) {
+    if (count > 0)
+      job(0, count);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->job = &job;
+    this->count = count;
+    this->batch = batch;
+    next.store(0, std::memory_order_relaxed);
+    generation++;
+  }
+  wake.notify_all();
+  work();
+
+  // the job lives on the caller's stack, so wait until the threads that
+  // joined are done with it. Any that wake from now on find the range used
+  // up and leave it alone.
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [this] { return busy == 0; });
+  this->job = NULL;
+}
+
+void WorkerPool::run()
+{
+  unsigned int done = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this, done] { return quit || generation != done; });
+      if (quit)
+        return;
+      done = generation;
+      // woken too late to help: nothing to wait for either
+      if (next.load(std::memory_order_relaxed) >= count)
+        continue;
+      busy++;
+    }
+    work();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--busy == 0)
+      finished.notify_one();
+  }
+}
+
+void WorkerPool::work()
+{
+  for (;;) {
+    size_t begin = next.fetch_add(batch, std::memory_order_relaxed);
+    if (begin >= count)
+      return;
+    (*job)(begin, std::min(begin + batch, count));
+  }
+}
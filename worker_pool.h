@@ -0,0 +1,60 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads that sleep until parallelFor() hands them a range to split. The
+// range is cut into batches that every thread, the calling one included,
+// takes off a shared counter until none are left, so a thread that is
+// slowed down just takes fewer. The threads live as long as the pool, so a
+// parallelFor() costs a wakeup rather than a thread start.
+class WorkerPool
+{
+public:
+  // job(begin, end) handles [begin, end) of the range
+  typedef std::function<void(size_t, size_t)> Job;
+
+  // threadCount counts the calling thread; 0 takes one per core
+  explicit WorkerPool(unsigned int threadCount = 0);
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // the threads that run a job, the calling one included
+  unsigned int getThreadCount() const;
+  // run job over [0, count) on all threads and return once it is done.
+  // Batches hold at least minBatch items; a range of one batch or less
+  // runs on the calling thread alone.
+  void parallelFor(size_t count, size_t minBatch, const Job &job);
+
+private:
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable finished;
+  // bumped for every job, a thread runs each generation once
+  unsigned int generation;
+  // threads that joined the current job and haven't finished it yet. A
+  // thread only joins while batches are left, so one that wakes late
+  // doesn't hold up the caller.
+  unsigned int busy;
+  bool quit;
+
+  // the current job, set under mutex before the threads are woken
+  const Job* job;
+  size_t count;
+  size_t batch;
+  std::atomic<size_t> next;
+
+  void run();
+  // take batches until the range is used up
+  void work();
+};
+#endif